@@ -33,6 +33,7 @@ static void cmd_remove( int argc, char *argv[], Options *opts );
 static void cmd_setting( int argc, char *argv[], Options *opts );
 static void cmd_editor( int argc, char *argv[], Options *opts );
 static void cmd_backup( int argc, char *argv[], Options *opts );
+static void cmd_compact( int argc, char *argv[], Options *opts );
 static void cmd_help( int argc, char *argv[], Options *opts );
 
 /* handler declarations for 'add' subcommands */
@@ -68,6 +69,7 @@ static Commands commands[] = { { "add", cmd_add },
                                { "setting", cmd_setting },
                                { "editor", cmd_editor },
                                { "backup", cmd_backup },
+                               { "compact", cmd_compact },
                                { "help", cmd_help },
                                { NULL, NULL } };
 
@@ -143,6 +145,7 @@ static void print_usage( const char *progname, const char *msg ) {
              "   setting    Change the note file in use. \n"
              "   editor     Change editor used. \n"
              "   backup     Run backup. \n"
+             "   compact    Reclaim the space of old notes. \n"
              "   help       Complete guide. \n",
              progname, progname );
 
@@ -468,7 +471,7 @@ static void cmd_modify( int argc, char *argv[], Options *opts ) {
 }
 
 // --------------------------------------
-/***** Implementation of (Organize, remove, setting, editor, backup, help) *****/
+/***** Implementation of (Organize, remove, setting, editor, backup, compact, help) *****/
 
 static void cmd_organize( int argc, char *argv[], Options *opts ) {
     if ( argc != 3 )
@@ -521,6 +524,13 @@ static void cmd_backup( int argc, char *argv[], Options *opts ) {
     opts->cmd = CMD_BACKUP;
 }
 
+static void cmd_compact( int argc, char *argv[], Options *opts ) {
+    if ( argc != 1 )
+        usage_error( "Usage: compact" );
+
+    opts->cmd = CMD_COMPACT;
+}
+
 static void cmd_help( int argc, char *argv[], Options *opts ) {
     if ( argc != 1 )
         usage_error( "Usage: help" );
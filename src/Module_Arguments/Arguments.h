@@ -39,6 +39,7 @@ typedef enum {
     CMD_SETTING,
     CMD_EDITOR,
     CMD_BACKUP,
+    CMD_COMPACT,
     CMD_HELP
 } Command;
 
@@ -0,0 +1,525 @@
+
+/*
+ * #################################################
+ *
+ *      Description:
+ * This module splits the notes into blocks compressed independently.
+ * The index at the end of the file maps every block to its range of
+ * the uncompressed notes, so a single record can be read by decoding
+ * only the blocks that hold it, and new notes are written by encoding
+ * only the blocks that follow the last full one.
+ *
+ *      License:
+ * This program is distributed under the terms of the GNU General Public License (GPL),
+ * ensuring the freedom to redistribute and modify the software in accordance with open-source standards.
+ *
+ *      Version:  1.0
+ *      Created:  18/07/2025
+ *
+ *      Author:
+ * Catoni Mirko (IMprojtech)
+ *
+ * #################################################
+ */
+
+#include "Block_Container.h"
+
+// --------------------------------------
+/* Support structures */
+typedef struct { //! Blocks shared by the workers, one block per task
+    const uint8_t *raw;
+    uint64_t raw_start; // Position of "raw" in the notes
+    BlockEntry *index;
+    uint32_t count;
+    uint32_t next; // Next block to be processed
+
+    uint8_t **packed;  // Compressed blocks waiting to be written
+    uint8_t *out;      // Destination of the decompressed blocks
+    int fd;            // File of the blocks to be decompressed
+    bool failed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready; // A compressed block is ready
+
+    const Codec *codec;
+} BlockJob;
+
+static const Codec codecs[] = {
+    { "huffman", "NTMH", BLOCK_HUFFMAN, huffman_bound, huffman_encode, huffman_decode },
+    { "lz", "NTML", BLOCK_LZ, lz_bound, lz_encode, lz_decode },
+};
+
+#define CODEC_COUNT ( sizeof( codecs ) / sizeof( codecs[0] ) )
+
+// Header of the containers with the index at the head, it ends before "index_offset"
+#define HEAD_INDEX_HEADER_SIZE offsetof( ContainerHeader, index_offset )
+
+// --------------------------------------
+/* Handler declarations */
+static void error_block( const char *msg );
+static const Codec *codec_by_magic( const char *magic );
+static const Codec *codec_by_type( uint32_t type );
+static size_t packed_bound( size_t len );
+static int worker_count( int threads, uint32_t count );
+static int start_workers( BlockJob *job, int workers, pthread_t *pool, void *( *worker )( void * ) );
+static uint32_t next_block( BlockJob *job );
+static void *encode_worker( void *arg );
+static void *decode_worker( void *arg );
+static bool read_packed( int fd, const BlockEntry *entry, uint8_t *packed );
+static bool decode_packed( const BlockEntry *entry, const uint8_t *packed, uint8_t *out );
+static bool decode_block( BlockReader *reader, uint32_t i, uint8_t *out );
+
+static void error_block( const char *msg ) {
+    fprintf( stderr, "Error in block container: %s \n", msg );
+    exit( EXIT_FAILURE );
+}
+
+// --------------------------------------
+/***** Codec lookups *****/
+const Codec *codec_by_name( const char *name ) {
+    for ( size_t i = 0; i < CODEC_COUNT; i++ )
+        if ( strcmp( codecs[i].name, name ) == 0 )
+            return &codecs[i];
+    return NULL;
+}
+
+static const Codec *codec_by_magic( const char *magic ) {
+    if ( memcmp( magic, BLOCK_MAGIC, 4 ) == 0 )
+        return codec_by_type( BLOCK_HUFFMAN );
+
+    for ( size_t i = 0; i < CODEC_COUNT; i++ )
+        if ( memcmp( codecs[i].magic, magic, 4 ) == 0 )
+            return &codecs[i];
+    return NULL;
+}
+
+static const Codec *codec_by_type( uint32_t type ) {
+    for ( size_t i = 0; i < CODEC_COUNT; i++ )
+        if ( codecs[i].type == type )
+            return &codecs[i];
+    return NULL;
+}
+
+// --------------------------------------
+/***** Largest compressed block of any codec *****/
+static size_t packed_bound( size_t len ) {
+    size_t bound = 0;
+    for ( size_t i = 0; i < CODEC_COUNT; i++ )
+        if ( codecs[i].bound( len ) > bound )
+            bound = codecs[i].bound( len );
+    return bound;
+}
+
+// --------------------------------------
+/***** Compression with the codec, or a plain copy when it does not pay *****/
+size_t codec_pack( const Codec *codec, const uint8_t *in, size_t len, uint8_t *out, uint32_t *type ) {
+
+    //! The Huffman coder gives up early on high entropy data, LZ has to try: repetitions do not show in the byte counts
+
+    size_t packed = codec->encode( in, len, out );
+
+    if ( packed == 0 || packed >= len ) {
+        memcpy( out, in, len );
+        *type = BLOCK_STORED;
+        return len;
+    }
+
+    *type = codec->type;
+    return packed;
+}
+
+// --------------------------------------
+/***** Decompression of data written by codec_pack *****/
+bool codec_unpack( uint32_t type, const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len ) {
+    if ( type == BLOCK_STORED ) {
+        if ( in_len != out_len )
+            return false;
+        memcpy( out, in, out_len );
+        return true;
+    }
+
+    const Codec *codec = codec_by_type( type );
+
+    return codec && codec->decode( in, in_len, out, out_len );
+}
+
+// --------------------------------------
+/***** Number of workers for "count" blocks (0 threads = one per core) *****/
+static int worker_count( int threads, uint32_t count ) {
+    if ( threads <= 0 )
+        threads = sysconf( _SC_NPROCESSORS_ONLN );
+    if ( threads < 1 )
+        threads = 1;
+    return (uint32_t)threads < count ? threads : (int)count;
+}
+
+// --------------------------------------
+/***** Start the workers, returns how many are running (0 = do the work in the caller) *****/
+static int start_workers( BlockJob *job, int workers, pthread_t *pool, void *( *worker )( void * ) ) {
+    if ( workers <= 1 )
+        return 0;
+
+    int started = 0;
+    while ( started < workers && pthread_create( &pool[started], NULL, worker, job ) == 0 )
+        started++;
+
+    return started;
+}
+
+// --------------------------------------
+/***** Next block to be processed (count when the job is over) *****/
+static uint32_t next_block( BlockJob *job ) {
+    pthread_mutex_lock( &job->lock );
+    uint32_t i = job->next < job->count ? job->next++ : job->count;
+    pthread_mutex_unlock( &job->lock );
+    return i;
+}
+
+// --------------------------------------
+/***** Compress blocks until the job is over *****/
+static void *encode_worker( void *arg ) {
+    BlockJob *job = arg;
+    uint32_t i;
+
+    while ( ( i = next_block( job ) ) < job->count ) {
+        BlockEntry *entry = &job->index[i];
+
+        uint32_t type;
+
+        uint8_t *packed = malloc( job->codec->bound( entry->raw_len ) );
+        if ( !packed )
+            error_block( "memory allocation" );
+
+        size_t len = codec_pack( job->codec, job->raw + ( entry->raw_offset - job->raw_start ), entry->raw_len, packed,
+                                 &type );
+
+        //! The block waits for the writer at its final size
+
+        uint8_t *fit = realloc( packed, len ? len : 1 );
+
+        pthread_mutex_lock( &job->lock );
+        job->packed[i] = fit ? fit : packed;
+        entry->length = len;
+        entry->type = type;
+        pthread_cond_broadcast( &job->ready );
+        pthread_mutex_unlock( &job->lock );
+    }
+    return NULL;
+}
+
+// --------------------------------------
+/***** Compression into a container, keeping the blocks before "from" *****/
+bool block_write( const char *path, const BlockReader *old, const uint8_t *data, uint64_t from, size_t size,
+                  const Codec *codec, int threads ) {
+
+    uint32_t count = ( size + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+    uint32_t keep = from / BLOCK_SIZE;
+
+    if ( from % BLOCK_SIZE != 0 || from > size || ( keep > 0 && ( !old || block_kept( old ) < from ) ) )
+        error_block( "blocks cannot be kept" );
+
+    BlockJob job = { 0 };
+    job.raw = data;
+    job.raw_start = from;
+    job.next = keep;
+    job.count = count;
+    job.codec = codec;
+    job.index = calloc( count ? count : 1, sizeof( BlockEntry ) );
+    job.packed = calloc( count ? count : 1, sizeof( uint8_t * ) );
+    if ( !job.index || !job.packed )
+        error_block( "memory allocation" );
+
+    //! The kept blocks stay where they are, the new ones are written after them
+
+    if ( keep > 0 )
+        memcpy( job.index, old->index, keep * sizeof( BlockEntry ) );
+
+    for ( uint32_t i = keep; i < count; i++ ) {
+        size_t raw_offset = (size_t)i * BLOCK_SIZE;
+
+        job.index[i].raw_offset = raw_offset;
+        job.index[i].raw_len = size - raw_offset < BLOCK_SIZE ? size - raw_offset : BLOCK_SIZE;
+    }
+
+    ContainerHeader header = { 0 };
+    memcpy( header.magic, codec->magic, sizeof( header.magic ) );
+    header.version = BLOCK_VERSION;
+    header.block_size = BLOCK_SIZE;
+    header.block_count = count;
+    header.raw_size = size;
+
+    FILE *out = fopen( path, keep > 0 ? "r+b" : "wb" );
+    if ( !out ) {
+        fprintf( stderr, "File \"%s\" creation failed \n", path );
+        exit( EXIT_FAILURE );
+    }
+
+    uint64_t offset = sizeof( ContainerHeader );
+    if ( keep > 0 )
+        offset = job.index[keep - 1].offset + job.index[keep - 1].length;
+
+    bool ok = fseek( out, offset, SEEK_SET ) == 0;
+
+    pthread_mutex_init( &job.lock, NULL );
+    pthread_cond_init( &job.ready, NULL );
+
+    int workers = worker_count( threads, count - keep );
+    pthread_t *pool = malloc( ( workers ? workers : 1 ) * sizeof( pthread_t ) );
+    if ( !pool )
+        error_block( "memory allocation" );
+
+    int started = start_workers( &job, workers, pool, encode_worker );
+    if ( started == 0 )
+        encode_worker( &job );
+
+    //! Blocks are written in order as soon as they are ready
+
+    for ( uint32_t i = keep; i < count; i++ ) {
+        pthread_mutex_lock( &job.lock );
+        while ( job.packed[i] == NULL )
+            pthread_cond_wait( &job.ready, &job.lock );
+        pthread_mutex_unlock( &job.lock );
+
+        job.index[i].offset = offset;
+        offset += job.index[i].length;
+
+        ok = ok && fwrite( job.packed[i], 1, job.index[i].length, out ) == job.index[i].length;
+        free( job.packed[i] );
+    }
+
+    for ( int i = 0; i < started; i++ )
+        pthread_join( pool[i], NULL );
+
+    //! Index after the blocks, then the header pointing to it
+
+    header.index_offset = offset;
+
+    ok = ok && fwrite( job.index, sizeof( BlockEntry ), count, out ) == count && fflush( out ) == 0 &&
+         ftruncate( fileno( out ), offset + (uint64_t)count * sizeof( BlockEntry ) ) == 0 &&
+         fseek( out, 0, SEEK_SET ) == 0 && fwrite( &header, sizeof( header ), 1, out ) == 1;
+
+    if ( fclose( out ) != 0 || !ok )
+        error_block( "file write failed" );
+
+    pthread_mutex_destroy( &job.lock );
+    pthread_cond_destroy( &job.ready );
+    free( pool );
+    free( job.index );
+    free( job.packed );
+    return true;
+}
+
+// --------------------------------------
+/***** Bytes covered by the full blocks, which a writer can keep *****/
+uint64_t block_kept( const BlockReader *reader ) {
+    const ContainerHeader *header = &reader->header;
+
+    //! Older containers and other block sizes are written again from the start
+
+    if ( header->version != BLOCK_VERSION || header->block_size != BLOCK_SIZE || header->block_count == 0 )
+        return 0;
+
+    const BlockEntry *last = &reader->index[header->block_count - 1];
+    return last->raw_len == header->block_size ? header->raw_size : last->raw_offset;
+}
+
+// --------------------------------------
+/***** Read the header and the block index *****/
+bool block_open( BlockReader *reader, int fd ) {
+    memset( reader, 0, sizeof( BlockReader ) );
+    reader->fd = fd;
+    reader->cached = -1;
+
+    ContainerHeader *header = &reader->header;
+    ssize_t header_len = pread( fd, header, sizeof( ContainerHeader ), 0 );
+
+    if ( header_len < (ssize_t)HEAD_INDEX_HEADER_SIZE || !( reader->codec = codec_by_magic( header->magic ) ) )
+        return false;
+
+    if ( header->version != BLOCK_VERSION && header->version != BLOCK_VERSION_HEAD_INDEX )
+        error_block( "version not supported" );
+
+    struct stat st;
+    fstat( fd, &st );
+
+    //! The blocks lie between the header and the index, or after the index in the older containers
+
+    size_t index_len = (size_t)header->block_count * sizeof( BlockEntry );
+    uint64_t blocks_start = sizeof( ContainerHeader ), blocks_end = header->index_offset;
+
+    if ( header->version == BLOCK_VERSION_HEAD_INDEX ) {
+        header->index_offset = HEAD_INDEX_HEADER_SIZE;
+        blocks_start = header->index_offset + index_len;
+        blocks_end = st.st_size;
+    }
+
+    if ( ( header->version == BLOCK_VERSION && header_len != sizeof( ContainerHeader ) ) || header->block_size == 0 ||
+         header->block_size > BLOCK_SIZE_MAX || header->index_offset > (uint64_t)st.st_size ||
+         index_len > (uint64_t)st.st_size - header->index_offset || blocks_start > blocks_end ||
+         blocks_end > (uint64_t)st.st_size )
+        error_block( "file corrupted" );
+
+    reader->index = malloc( index_len ? index_len : 1 );
+    reader->block = malloc( header->block_size );
+    reader->packed = malloc( packed_bound( header->block_size ) );
+    if ( !reader->index || !reader->block || !reader->packed )
+        error_block( "memory allocation" );
+
+    if ( pread( fd, reader->index, index_len, header->index_offset ) != (ssize_t)index_len )
+        error_block( "file corrupted" );
+
+    //! Every block must be full and follow the previous one, both in the notes and in the file
+
+    uint64_t raw_offset = 0, offset = blocks_start;
+    for ( uint32_t i = 0; i < header->block_count; i++ ) {
+        const BlockEntry *entry = &reader->index[i];
+        bool last = i + 1 == header->block_count;
+
+        if ( entry->raw_offset != raw_offset || entry->raw_len > header->block_size ||
+             ( !last && entry->raw_len != header->block_size ) ||
+             ( entry->type == BLOCK_STORED && entry->length != entry->raw_len ) ||
+             entry->length > packed_bound( header->block_size ) || entry->offset != offset ||
+             entry->length > blocks_end - offset )
+            error_block( "file corrupted" );
+
+        raw_offset += entry->raw_len;
+        offset += entry->length;
+    }
+
+    if ( raw_offset != header->raw_size )
+        error_block( "file corrupted" );
+
+    return true;
+}
+
+// --------------------------------------
+/***** Read a compressed block from the file *****/
+static bool read_packed( int fd, const BlockEntry *entry, uint8_t *packed ) {
+    return pread( fd, packed, entry->length, entry->offset ) == (ssize_t)entry->length;
+}
+
+// --------------------------------------
+/***** Decompress a block read from the file *****/
+static bool decode_packed( const BlockEntry *entry, const uint8_t *packed, uint8_t *out ) {
+    return codec_unpack( entry->type, packed, entry->length, out, entry->raw_len );
+}
+
+// --------------------------------------
+/***** Decompress block "i" into "out" *****/
+static bool decode_block( BlockReader *reader, uint32_t i, uint8_t *out ) {
+    const BlockEntry *entry = &reader->index[i];
+
+    if ( entry->type == BLOCK_STORED ) // Read straight into place
+        return read_packed( reader->fd, entry, out );
+
+    return read_packed( reader->fd, entry, reader->packed ) && decode_packed( entry, reader->packed, out );
+}
+
+// --------------------------------------
+/***** Random access to the uncompressed notes *****/
+bool block_read( BlockReader *reader, uint64_t offset, size_t len, uint8_t *out ) {
+
+    if ( offset + len > reader->header.raw_size )
+        return false;
+
+    while ( len > 0 ) {
+        uint32_t i = offset / reader->header.block_size;
+        const BlockEntry *entry = &reader->index[i];
+
+        size_t skip = offset - entry->raw_offset;
+        size_t chunk = entry->raw_len - skip < len ? entry->raw_len - skip : len;
+
+        //! Whole and stored blocks are read in place, partial ones go through the cache
+
+        if ( entry->type == BLOCK_STORED ) {
+            if ( pread( reader->fd, out, chunk, entry->offset + skip ) != (ssize_t)chunk )
+                return false;
+
+        } else if ( skip == 0 && chunk == entry->raw_len ) {
+            if ( !decode_block( reader, i, out ) )
+                return false;
+
+        } else {
+            if ( reader->cached != (long)i ) {
+                reader->cached = -1;
+                if ( !decode_block( reader, i, reader->block ) )
+                    return false;
+                reader->cached = i;
+            }
+            memcpy( out, reader->block + skip, chunk );
+        }
+
+        out += chunk;
+        offset += chunk;
+        len -= chunk;
+    }
+
+    return true;
+}
+
+// --------------------------------------
+/***** Decompress blocks until the job is over *****/
+static void *decode_worker( void *arg ) {
+    BlockJob *job = arg;
+    uint32_t i;
+
+    uint8_t *packed = malloc( packed_bound( BLOCK_SIZE_MAX ) );
+    if ( !packed )
+        error_block( "memory allocation" );
+
+    while ( ( i = next_block( job ) ) < job->count ) {
+        const BlockEntry *entry = &job->index[i];
+
+        uint8_t *out = job->out + entry->raw_offset;
+        bool ok = entry->type == BLOCK_STORED ? read_packed( job->fd, entry, out )
+                                              : read_packed( job->fd, entry, packed ) && decode_packed( entry, packed, out );
+
+        if ( !ok ) {
+            pthread_mutex_lock( &job->lock );
+            job->failed = true;
+            pthread_mutex_unlock( &job->lock );
+        }
+    }
+
+    free( packed );
+    return NULL;
+}
+
+// --------------------------------------
+/***** Decompress the whole container, one block per task *****/
+bool block_read_all( BlockReader *reader, uint8_t *out, int threads ) {
+
+    BlockJob job = { 0 };
+    job.index = reader->index;
+    job.count = reader->header.block_count;
+    job.out = out;
+    job.fd = reader->fd;
+
+    pthread_mutex_init( &job.lock, NULL );
+
+    int workers = worker_count( threads, job.count );
+    pthread_t *pool = malloc( ( workers ? workers : 1 ) * sizeof( pthread_t ) );
+    if ( !pool )
+        error_block( "memory allocation" );
+
+    int started = start_workers( &job, workers, pool, decode_worker );
+    if ( started == 0 )
+        decode_worker( &job );
+
+    for ( int i = 0; i < started; i++ )
+        pthread_join( pool[i], NULL );
+
+    pthread_mutex_destroy( &job.lock );
+    free( pool );
+    return !job.failed;
+}
+
+// --------------------------------------
+/***** Release the reader *****/
+void block_close( BlockReader *reader ) {
+    free( reader->index );
+    free( reader->block );
+    free( reader->packed );
+    memset( reader, 0, sizeof( BlockReader ) );
+    reader->cached = -1;
+}
@@ -0,0 +1,111 @@
+
+/*
+ * #################################################
+ *
+ *              Description:
+ * Header associated with Block_Container.c.
+ *
+ *      License:
+ * This program is distributed under the terms of the GNU General Public License (GPL),
+ * ensuring the freedom to redistribute and modify the software in accordance with open-source standards.
+ *
+ *      Author:
+ * Catoni Mirko (IMprojtech)
+ *
+ * #################################################
+ */
+
+#ifndef BLOCK_CONTAINER_H
+#define BLOCK_CONTAINER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "Huffman_Coding.h"
+#include "LZ_Coding.h"
+
+#define BLOCK_MAGIC "NTMB" // Containers written before the codecs could be chosen (Huffman)
+#define BLOCK_VERSION 2            // Block index after the blocks
+#define BLOCK_VERSION_HEAD_INDEX 1 // Block index right after the header
+#define BLOCK_SIZE ( 64 * 1024 )      // Uncompressed bytes of each block
+#define BLOCK_SIZE_MAX ( 1024 * 1024 ) // Largest block accepted when reading
+
+// Block types
+#define BLOCK_HUFFMAN 1
+#define BLOCK_LZ 2
+#define BLOCK_STORED 3 // Kept uncompressed, coding would not make it smaller
+
+typedef struct { //! Codec of the blocks, the magic of the file identifies it
+    const char *name;
+    const char *magic;
+    uint32_t type;
+    size_t ( *bound )( size_t len );
+    size_t ( *encode )( const uint8_t *in, size_t len, uint8_t *out );
+    bool ( *decode )( const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len );
+} Codec;
+
+typedef struct { //! Header of the container, followed by the blocks and the block index
+    char magic[4];
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t block_count;
+    uint64_t raw_size;
+    uint64_t index_offset; // Position of the block index (missing in BLOCK_VERSION_HEAD_INDEX)
+} ContainerHeader;
+
+typedef struct { //! Entry of the block index
+    uint64_t raw_offset; // Position in the uncompressed notes
+    uint64_t offset;     // Position of the compressed block in the file
+    uint32_t raw_len;
+    uint32_t length;
+    uint32_t type;
+    uint32_t reserved;
+} BlockEntry;
+
+typedef struct { //! Container opened for random access
+    int fd;
+    ContainerHeader header;
+    BlockEntry *index;
+    uint8_t *block;  // Last block decompressed
+    uint8_t *packed; // Compressed block read from the file
+    long cached;     // Index of the block held in "block" (-1 if none)
+    const Codec *codec;
+} BlockReader;
+
+// Codec with the given name (NULL if unknown)
+const Codec *codec_by_name( const char *name );
+
+// Compress "in", or copy it when coding would not make it smaller ("type" receives the block type)
+size_t codec_pack( const Codec *codec, const uint8_t *in, size_t len, uint8_t *out, uint32_t *type );
+
+// Decompress data written by codec_pack
+bool codec_unpack( uint32_t type, const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len );
+
+// Write the notes as a container of independent blocks (0 threads = one per core).
+// "data" holds the notes from "from" to "size", the blocks before "from" are kept from "old" (NULL if "from" is 0)
+bool block_write( const char *path, const BlockReader *old, const uint8_t *data, uint64_t from, size_t size,
+                  const Codec *codec, int threads );
+
+// Bytes at the head of the notes whose blocks block_write can keep (0 if the container must be written again)
+uint64_t block_kept( const BlockReader *reader );
+
+// Open a container for random access (false if the file is not a container)
+bool block_open( BlockReader *reader, int fd );
+
+// Decompress the range [offset, offset + len) decoding only the blocks holding it
+bool block_read( BlockReader *reader, uint64_t offset, size_t len, uint8_t *out );
+
+// Decompress every block into "out" (raw_size bytes), spread across the threads
+bool block_read_all( BlockReader *reader, uint8_t *out, int threads );
+
+// Release the reader (the descriptor is left open)
+void block_close( BlockReader *reader );
+
+#endif // BLOCK_CONTAINER_H
@@ -23,23 +23,60 @@
 // --------------------------------------
 /* Support structures */
 typedef struct {
-    uint64_t bits;
+    uint32_t bits;
     int len;
 } HuffCode;
 
+typedef struct { //! Symbol ordered by frequency when lengths are assigned
+    uint32_t freq;
+    uint16_t symbol;
+} SymbolFreq;
+
 typedef struct {
     HuffNode **data;
     int size;
     int capacity;
 } MinHeap;
 
+typedef struct { //! Entry of the decoding tables
+    uint16_t value; // Symbol, or number of the subtable when bits == 0
+    uint8_t bits;   // Bits taken by the symbol
+} DecodeEntry;
+
+typedef struct { //! Primary table followed by the overflow subtables
+    DecodeEntry *entries;
+    size_t count;
+    size_t capacity;
+} DecodeTable;
+
+typedef struct { //! Writes the bitstream MSB first, 32 bits at a time
+    uint8_t *ptr;
+    uint64_t buf; // Pending bits in the low "count" bits
+    int count;
+} BitWriter;
+
+typedef struct { //! Reads the bitstream MSB first, 64 bits at a time
+    const uint8_t *ptr;
+    const uint8_t *end;
+    uint64_t buf;
+    int count;
+} BitReader;
+
 // --------------------------------------
 /* Handler declarations */
 static MinHeap *heap_create( int capacity );
 static void heap_push( MinHeap *heap, HuffNode *node );
 static HuffNode *heap_pop( MinHeap *heap );
 static void heap_destroy( MinHeap *heap );
-static void build_code_table( HuffNode *node, HuffCode table[256], uint64_t bits, int len );
+static void tree_depths( HuffNode *node, int depth, int depths[256] );
+static void build_code_lengths( const uint32_t freq[256], uint8_t lengths[256] );
+static void build_code_table( const uint8_t lengths[256], HuffCode table[256] );
+static HuffNode *build_canonical_tree( const uint8_t lengths[256] );
+static void count_freq( const uint8_t *in, size_t len, uint32_t freq[256] );
+static inline void put_bits( BitWriter *bw, HuffCode code );
+static inline void flush_bits( BitWriter *bw );
+static uint16_t build_decode_table( DecodeTable *table, HuffNode *node );
+static void decode_stream( HuffNode *root, const uint8_t *in, size_t in_len, uint8_t *out, size_t total );
 
 static MinHeap *heap_create( int capacity ) {
     MinHeap *heap = malloc( sizeof( MinHeap ) );
@@ -123,146 +160,442 @@ void huffman_free_tree( HuffNode *node ) {
 }
 
 // --------------------------------------
-/***** Code generation *****/
-static void build_code_table( HuffNode *node, HuffCode table[256], uint64_t bits, int len ) {
+/***** Depth of each leaf in the tree *****/
+static void tree_depths( HuffNode *node, int depth, int depths[256] ) {
     if ( !node->left && !node->right ) {
-        table[node->symbol].bits = bits;
-        table[node->symbol].len = len;
+        depths[node->symbol] = depth;
         return;
     }
     if ( node->left )
-        build_code_table( node->left, table, ( bits << 1 ), len + 1 );
+        tree_depths( node->left, depth + 1, depths );
     if ( node->right )
-        build_code_table( node->right, table, ( bits << 1 ) | 1, len + 1 );
+        tree_depths( node->right, depth + 1, depths );
+}
+
+static int compare_freq( const void *a, const void *b ) {
+    const SymbolFreq *x = a, *y = b;
+    if ( x->freq != y->freq )
+        return x->freq < y->freq ? 1 : -1;
+    return x->symbol - y->symbol;
 }
 
 // --------------------------------------
-/***** Compression *****/
-bool huffman_compress_file( const char *in_path, const char *out_path ) {
-    FILE *in = fopen( in_path, "rb" );
-    if ( !in ) {
-        fprintf( stderr, "File \"%s\" opening failed \n", in_path );
-        exit( EXIT_FAILURE );
+/***** Code lengths limited to HUFF_MAX_BITS *****/
+static void build_code_lengths( const uint32_t freq[256], uint8_t lengths[256] ) {
+    memset( lengths, 0, 256 );
+
+    HuffNode *root = huffman_build_tree( (uint32_t *)freq );
+    if ( !root )
+        return;
+
+    //! A single symbol still needs one bit
+
+    if ( !root->left && !root->right ) {
+        lengths[root->symbol] = 1;
+        huffman_free_tree( root );
+        return;
     }
 
-    uint32_t freq[256] = { 0 };
-    int c;
-    while ( ( c = fgetc( in ) ) != EOF )
-        freq[(uint8_t)c]++;
-    rewind( in );
+    int depths[256] = { 0 };
+    tree_depths( root, 0, depths );
+    huffman_free_tree( root );
 
-    HuffNode *root = huffman_build_tree( freq );
-    if ( !root ) {
-        fclose( in );
-        fprintf( stderr, "Error in Compression tree \n" );
-        exit( EXIT_FAILURE );
+    uint32_t count[257] = { 0 };
+    int max_depth = 0;
+    for ( int i = 0; i < 256; i++ ) {
+        if ( freq[i] > 0 ) {
+            count[depths[i]]++;
+            if ( depths[i] > max_depth )
+                max_depth = depths[i];
+        }
     }
 
-    HuffCode table[256] = { 0 };
-    build_code_table( root, table, 0, 0 );
+    //! Leaves deeper than the limit move up in pairs, taking the place of a shallower leaf (JPEG, Annex K.3)
 
-    FILE *out = fopen( out_path, "wb" );
-    if ( !out ) {
-        fclose( in );
-        huffman_free_tree( root );
-        fprintf( stderr, "File \"%s\" creation failed \n", out_path );
-        exit( EXIT_FAILURE );
+    for ( int i = max_depth; i > HUFF_MAX_BITS; i-- ) {
+        while ( count[i] > 0 ) {
+            int j = i - 2;
+            while ( count[j] == 0 )
+                j--;
+
+            count[i] -= 2;
+            count[i - 1]++;
+            count[j + 1] += 2;
+            count[j]--;
+        }
+    }
+
+    //! The most frequent symbols take the shortest codes
+
+    SymbolFreq order[256];
+    int used = 0;
+    for ( int i = 0; i < 256; i++ ) {
+        if ( freq[i] > 0 )
+            order[used++] = (SymbolFreq){ freq[i], (uint16_t)i };
+    }
+    qsort( order, used, sizeof( SymbolFreq ), compare_freq );
+
+    int len = 1;
+    for ( int i = 0; i < used; i++ ) {
+        while ( count[len] == 0 )
+            len++;
+        lengths[order[i].symbol] = len;
+        count[len]--;
     }
+}
 
-    fwrite( "HUFF", 1, 4, out );
-    fwrite( freq, sizeof( uint32_t ), 256, out );
+// --------------------------------------
+/***** Canonical codes from the code lengths *****/
+static void build_code_table( const uint8_t lengths[256], HuffCode table[256] ) {
+    uint32_t count[HUFF_MAX_BITS + 1] = { 0 };
+    uint32_t next[HUFF_MAX_BITS + 2] = { 0 };
+
+    for ( int i = 0; i < 256; i++ )
+        count[lengths[i]]++;
+    count[0] = 0;
+
+    uint32_t code = 0;
+    for ( int len = 1; len <= HUFF_MAX_BITS; len++ ) {
+        code = ( code + count[len - 1] ) << 1;
+        next[len] = code;
+    }
+
+    for ( int i = 0; i < 256; i++ ) {
+        table[i].len = lengths[i];
+        table[i].bits = lengths[i] ? next[lengths[i]]++ : 0;
+    }
+}
+
+// --------------------------------------
+/***** Tree of the canonical codes (NULL if the lengths are not valid) *****/
+static HuffNode *build_canonical_tree( const uint8_t lengths[256] ) {
+    HuffCode table[256];
+    build_code_table( lengths, table );
+
+    HuffNode *root = calloc( 1, sizeof( HuffNode ) );
+
+    for ( int i = 0; i < 256; i++ ) {
+        if ( table[i].len == 0 )
+            continue;
+
+        HuffNode *node = root;
+        for ( int bit = table[i].len - 1; bit >= 0; bit-- ) {
+            if ( node->freq ) { // A shorter code is a prefix of this one
+                huffman_free_tree( root );
+                return NULL;
+            }
 
-    uint64_t buffer = 0;
-    int bits = 0;
-    while ( ( c = fgetc( in ) ) != EOF ) {
-        HuffCode code = table[(uint8_t)c];
-        buffer = ( buffer << code.len ) | code.bits;
-        bits += code.len;
+            HuffNode **next = ( ( table[i].bits >> bit ) & 1 ) ? &node->right : &node->left;
+            if ( !*next )
+                *next = calloc( 1, sizeof( HuffNode ) );
+            node = *next;
+        }
 
-        while ( bits >= 8 ) {
-            uint8_t b = ( buffer >> ( bits - 8 ) ) & 0xFF;
-            fputc( b, out );
-            bits -= 8;
+        if ( node->freq || node->left || node->right ) {
+            huffman_free_tree( root );
+            return NULL;
         }
+        node->symbol = (uint8_t)i;
+        node->freq = 1; // Marks the leaves
     }
 
-    if ( bits > 0 ) {
-        uint8_t b = ( buffer << ( 8 - bits ) ) & 0xFF;
-        fputc( b, out );
+    return root;
+}
+
+// --------------------------------------
+/***** Worst case size of an encoded block *****/
+size_t huffman_bound( size_t len ) {
+    return HUFF_HEADER_SIZE + len * HUFF_MAX_BITS / 8 + 8;
+}
+
+// --------------------------------------
+/***** Symbol frequencies of the block *****/
+static void count_freq( const uint8_t *in, size_t len, uint32_t freq[256] ) {
+
+    //! Four histograms, so runs of the same byte do not wait on the previous increment
+
+    uint32_t hist[4][256] = { { 0 } };
+    size_t i = 0;
+
+    for ( ; i + 4 <= len; i += 4 ) {
+        hist[0][in[i]]++;
+        hist[1][in[i + 1]]++;
+        hist[2][in[i + 2]]++;
+        hist[3][in[i + 3]]++;
     }
+    for ( ; i < len; i++ )
+        hist[0][in[i]]++;
 
-    fclose( in );
-    fclose( out );
+    for ( int s = 0; s < 256; s++ )
+        freq[s] = hist[0][s] + hist[1][s] + hist[2][s] + hist[3][s];
+}
+
+// --------------------------------------
+/***** Append a code to the bitstream (at most 31 bits pending before) *****/
+static inline void put_bits( BitWriter *bw, HuffCode code ) {
+    bw->buf = ( bw->buf << code.len ) | code.bits;
+    bw->count += code.len;
+}
+
+// --------------------------------------
+/***** Store 32 bits once they are available *****/
+static inline void flush_bits( BitWriter *bw ) {
+    if ( bw->count < 32 )
+        return;
+
+    uint32_t word = bw->buf >> ( bw->count - 32 );
+    bw->ptr[0] = word >> 24;
+    bw->ptr[1] = word >> 16;
+    bw->ptr[2] = word >> 8;
+    bw->ptr[3] = word;
+    bw->ptr += 4;
+    bw->count -= 32;
+}
+
+// --------------------------------------
+/***** Compression of a block, returns the bytes written in "out" (0 if it would not get smaller) *****/
+size_t huffman_encode( const uint8_t *in, size_t len, uint8_t *out ) {
+
+    uint32_t freq[256];
+    count_freq( in, len, freq );
+
+    uint8_t lengths[256];
+    build_code_lengths( freq, lengths );
+
+    //! The size is known from the code lengths, high entropy data (protected notes) is not encoded
+
+    uint64_t bits = 0;
+    for ( int i = 0; i < 256; i++ )
+        bits += (uint64_t)freq[i] * lengths[i];
+
+    if ( HUFF_HEADER_SIZE + ( bits + 7 ) / 8 >= len )
+        return 0;
+
+    HuffCode table[256];
+    build_code_table( lengths, table );
+
+    //! Header: the code lengths packed in 4 bits
+
+    for ( int i = 0; i < HUFF_HEADER_SIZE; i++ )
+        out[i] = lengths[i * 2] | lengths[i * 2 + 1] << 4;
+
+    //! Codes are at most 15 bits, so two of them fit before each flush
+
+    BitWriter bw = { out + HUFF_HEADER_SIZE, 0, 0 };
+    size_t i = 0;
+
+    for ( ; i + 2 <= len; i += 2 ) {
+        put_bits( &bw, table[in[i]] );
+        put_bits( &bw, table[in[i + 1]] );
+        flush_bits( &bw );
+    }
+    if ( i < len )
+        put_bits( &bw, table[in[i]] );
+    flush_bits( &bw );
+
+    //! The last bits are padded with zeros to a whole byte
+
+    while ( bw.count > 0 ) {
+        int shift = bw.count - 8;
+        *bw.ptr++ = shift >= 0 ? bw.buf >> shift : bw.buf << -shift;
+        bw.count -= 8;
+    }
+
+    return bw.ptr - out;
+}
+
+// --------------------------------------
+/***** Decoding tables (DECODE_BITS per level) *****/
+static uint16_t build_decode_table( DecodeTable *table, HuffNode *node ) {
+    size_t size = (size_t)1 << DECODE_BITS;
+
+    if ( table->count + size > table->capacity ) {
+        table->capacity = ( table->count + size ) * 2;
+        table->entries = realloc( table->entries, table->capacity * sizeof( DecodeEntry ) );
+        if ( !table->entries ) {
+            fprintf( stderr, "Error in decompression tree \n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    size_t first = table->count;
+    table->count += size;
+
+    //! Codes longer than DECODE_BITS continue in a subtable rooted at the node reached
+
+    for ( size_t i = 0; i < size; i++ ) {
+        HuffNode *n = node;
+        int depth = 0;
+
+        while ( n && depth < DECODE_BITS && ( n->left || n->right ) ) {
+            n = ( ( i >> ( DECODE_BITS - 1 - depth ) ) & 1 ) ? n->right : n->left;
+            depth++;
+        }
+
+        DecodeEntry entry;
+        if ( !n ) { // Unused code (corrupted stream)
+            entry.value = 0;
+            entry.bits = depth;
+        } else if ( !n->left && !n->right ) {
+            entry.value = n->symbol;
+            entry.bits = depth;
+        } else {
+            entry.value = build_decode_table( table, n );
+            entry.bits = 0;
+        }
+        table->entries[first + i] = entry;
+    }
+
+    return first >> DECODE_BITS;
+}
+
+// --------------------------------------
+/***** Keeps at least 57 bits in the reader *****/
+static inline void refill( BitReader *br ) {
+    if ( br->end - br->ptr >= 8 ) {
+        const uint8_t *p = br->ptr;
+        uint64_t word = (uint64_t)p[0] << 56 | (uint64_t)p[1] << 48 | (uint64_t)p[2] << 40 |
+                        (uint64_t)p[3] << 32 | (uint64_t)p[4] << 24 | (uint64_t)p[5] << 16 |
+                        (uint64_t)p[6] << 8 | (uint64_t)p[7];
+
+        br->buf |= word >> br->count;
+        br->ptr += ( 63 - br->count ) >> 3;
+        br->count |= 56;
+        return;
+    }
+
+    //! Past the end the stream is padded with zeros
+
+    while ( br->count <= 56 ) {
+        uint64_t byte = br->ptr < br->end ? *br->ptr++ : 0;
+        br->buf |= byte << ( 56 - br->count );
+        br->count += 8;
+    }
+}
+
+// --------------------------------------
+/***** Decode "total" symbols from the bitstream *****/
+static void decode_stream( HuffNode *root, const uint8_t *in, size_t in_len, uint8_t *out, size_t total ) {
+
+    //! A single symbol has an empty code
+
+    if ( !root->left && !root->right ) {
+        memset( out, root->symbol, total );
+        return;
+    }
+
+    DecodeTable table = { 0 };
+    build_decode_table( &table, root );
+    const DecodeEntry *entries = table.entries;
+
+    BitReader br = { in, in + in_len, 0, 0 };
+    size_t written = 0;
+
+    //! Symbols are decoded until the bits left cannot cover a primary lookup
+
+    while ( written < total ) {
+        refill( &br );
+
+        while ( br.count >= DECODE_BITS && written < total ) {
+            DecodeEntry entry = entries[br.buf >> ( 64 - DECODE_BITS )];
+
+            if ( entry.bits == 0 ) { // Long code, resolved through the subtables
+                while ( entry.bits == 0 ) {
+                    br.buf <<= DECODE_BITS;
+                    br.count -= DECODE_BITS;
+                    refill( &br );
+                    entry = entries[( (size_t)entry.value << DECODE_BITS ) + ( br.buf >> ( 64 - DECODE_BITS ) )];
+                }
+            }
+
+            br.buf <<= entry.bits;
+            br.count -= entry.bits;
+            out[written++] = (uint8_t)entry.value;
+        }
+    }
+
+    free( table.entries );
+}
+
+// --------------------------------------
+/***** Decompression of a block of "out_len" bytes *****/
+bool huffman_decode( const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len ) {
+    if ( in_len < HUFF_HEADER_SIZE )
+        return false;
+
+    uint8_t lengths[256];
+    for ( int i = 0; i < HUFF_HEADER_SIZE; i++ ) {
+        lengths[i * 2] = in[i] & 0x0F;
+        lengths[i * 2 + 1] = in[i] >> 4;
+    }
+
+    HuffNode *root = build_canonical_tree( lengths );
+    if ( !root )
+        return false;
+
+    decode_stream( root, in + HUFF_HEADER_SIZE, in_len - HUFF_HEADER_SIZE, out, out_len );
     huffman_free_tree( root );
     return true;
 }
 
 // --------------------------------------
-/***** Decompression *****/
-bool huffman_decompress_file( const char *in_path, const char *out_path ) {
+/***** Decompression of a single stream file (written before the block container) *****/
+bool huffman_decompress_buffer( const char *in_path, uint8_t **data, size_t *size ) {
     FILE *in = fopen( in_path, "rb" );
     if ( !in )
         return false;
 
-    FILE *out = fopen( out_path, "wb" );
-    if ( !out ) {
+    fseek( in, 0, SEEK_END );
+    long in_len = ftell( in );
+    rewind( in );
+
+    if ( in_len < 4 ) {
         fclose( in );
-        fprintf( stderr, "File \"%s\" creation failed \n", out_path );
-        exit( EXIT_FAILURE );
+        return false;
     }
 
-    char magic[5] = { 0 };
-    fread( magic, 1, 4, in );
-    if ( strcmp( magic, "HUFF" ) != 0 ) {
+    uint8_t *buf = malloc( in_len );
+    if ( !buf || fread( buf, 1, in_len, in ) != (size_t)in_len ) {
         fclose( in );
-        fclose( out );
+        fprintf( stderr, "File \"%s\" reading failed \n", in_path );
+        exit( EXIT_FAILURE );
+    }
+    fclose( in );
+
+    if ( memcmp( buf, HUFF_MAGIC_LEGACY, 4 ) != 0 || in_len < 4 + 256 * 4 ) {
+        free( buf );
         return false;
     }
 
-    uint32_t freq[256] = { 0 };
+    //! Header: the frequency of every symbol, their sum is the uncompressed size
+
+    uint32_t freq[256];
+    memcpy( freq, buf + 4, sizeof( freq ) );
+
     uint64_t total = 0;
-    for ( int i = 0; i < 256; ++i ) {
-        fread( &freq[i], sizeof( uint32_t ), 1, in );
+    for ( int i = 0; i < 256; ++i )
         total += freq[i];
-    }
 
     if ( total == 0 ) {
-        fclose( in );
-        fclose( out );
+        free( buf );
         return false;
     }
 
     HuffNode *root = huffman_build_tree( freq );
-    if ( !root ) {
-        fclose( in );
-        fclose( out );
+    uint8_t *out = malloc( total );
+    bool ok = root && out;
+    if ( ok )
+        decode_stream( root, buf + 4 + sizeof( freq ), in_len - 4 - sizeof( freq ), out, total );
+    huffman_free_tree( root );
+
+    free( buf );
+
+    if ( !ok ) {
         fprintf( stderr, "Error in decompression tree \n" );
         exit( EXIT_FAILURE );
     }
 
-    HuffNode *node = root;
-    int c, bit;
-    uint8_t byte = 0;
-    int bits_left = 0;
-    uint64_t written = 0;
-
-    while ( written < total && ( c = fgetc( in ) ) != EOF ) {
-        byte = (uint8_t)c;
-        bits_left = 8;
-
-        while ( bits_left-- && written < total ) {
-            bit = ( byte >> bits_left ) & 1;
-            node = bit ? node->right : node->left;
-            if ( !node->left && !node->right ) {
-                fputc( node->symbol, out );
-                written++;
-                node = root;
-            }
-        }
-    }
-
-    fclose( in );
-    fclose( out );
-    huffman_free_tree( root );
+    *data = out;
+    *size = total;
     return true;
 }
@@ -24,14 +24,26 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#define HUFF_MAGIC_LEGACY "HUFF" // Single stream, frequency table
+#define HUFF_MAX_BITS 15
+#define HUFF_HEADER_SIZE 128 // Code lengths of a block (4 bits each)
+
+// Bits resolved by each level of the decoding tables
+#define DECODE_BITS 11
+
 typedef struct HuffNode {
     uint8_t symbol;
     uint32_t freq;
     struct HuffNode *left, *right;
 } HuffNode;
 
-bool huffman_compress_file( const char *in_path, const char *out_path );
-bool huffman_decompress_file( const char *in_path, const char *out_path );
+// Compression of independent blocks
+size_t huffman_bound( size_t len );
+size_t huffman_encode( const uint8_t *in, size_t len, uint8_t *out );
+bool huffman_decode( const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len );
+
+// Files written as a single stream
+bool huffman_decompress_buffer( const char *in_path, uint8_t **data, size_t *size );
 
 // For internal use
 HuffNode *huffman_build_tree( uint32_t freq[256] );
@@ -0,0 +1,297 @@
+
+/*
+ * #################################################
+ *
+ *      Description:
+ * LZ77 codec for the blocks of the notes.
+ * Repeated strings (tags, paths, record headers) are replaced by
+ * references to a previous occurrence, then literals, sequence tokens,
+ * extra lengths and offsets are stored as separate streams, each one
+ * Huffman coded when that makes it smaller.
+ *
+ *      License:
+ * This program is distributed under the terms of the GNU General Public License (GPL),
+ * ensuring the freedom to redistribute and modify the software in accordance with open-source standards.
+ *
+ *      Version:  1.0
+ *      Created:  18/07/2025
+ *
+ *      Author:
+ * Catoni Mirko (IMprojtech)
+ *
+ * #################################################
+ */
+
+#include "LZ_Coding.h"
+
+// --------------------------------------
+/* Support structures */
+typedef struct { //! Growing output stream of the parser
+    uint8_t *data;
+    size_t len;
+} LzStream;
+
+typedef struct { //! Header of a stream in the block
+    uint32_t raw_len;
+    uint32_t len; // Equal to raw_len when the stream is stored as is
+} LzStreamHeader;
+
+// --------------------------------------
+/* Handler declarations */
+static inline uint32_t hash4( const uint8_t *p );
+static void put_length( LzStream *extra, size_t len );
+static void put_sequence( LzStream *streams, const uint8_t *lit, size_t lit_len, size_t match_len, size_t offset );
+static bool get_length( const uint8_t **pos, const uint8_t *end, size_t *len );
+
+static inline uint32_t hash4( const uint8_t *p ) {
+    uint32_t v;
+    memcpy( &v, p, sizeof( v ) );
+    return ( v * 2654435761u ) >> ( 32 - LZ_HASH_BITS );
+}
+
+// --------------------------------------
+/***** Worst case size of an encoded block *****/
+size_t lz_bound( size_t len ) {
+    return LZ_STREAMS * sizeof( LzStreamHeader ) + len + len / 64 + 64;
+}
+
+// --------------------------------------
+/***** Length beyond the 4 bits of the token (255 = continue) *****/
+static void put_length( LzStream *extra, size_t len ) {
+    while ( len >= 255 ) {
+        extra->data[extra->len++] = 255;
+        len -= 255;
+    }
+    extra->data[extra->len++] = (uint8_t)len;
+}
+
+// --------------------------------------
+/***** Literals followed by a match (match_len 0 ends the block) *****/
+static void put_sequence( LzStream *streams, const uint8_t *lit, size_t lit_len, size_t match_len, size_t offset ) {
+    LzStream *literals = &streams[0], *tokens = &streams[1], *extra = &streams[2], *offsets = &streams[3];
+
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    tokens->data[tokens->len++] = ( lit_len < 15 ? lit_len : 15 ) << 4 | ( ml < 15 ? ml : 15 );
+
+    if ( lit_len >= 15 )
+        put_length( extra, lit_len - 15 );
+
+    memcpy( literals->data + literals->len, lit, lit_len );
+    literals->len += lit_len;
+
+    if ( match_len == 0 )
+        return;
+
+    if ( ml >= 15 )
+        put_length( extra, ml - 15 );
+
+    offsets->data[offsets->len++] = offset & 0xFF;
+    offsets->data[offsets->len++] = offset >> 8;
+}
+
+// --------------------------------------
+/***** Compression of a block, returns the bytes written in "out" *****/
+size_t lz_encode( const uint8_t *in, size_t len, uint8_t *out ) {
+
+    LzStream streams[LZ_STREAMS];
+    for ( int s = 0; s < LZ_STREAMS; s++ ) {
+        streams[s].data = malloc( len + 16 );
+        streams[s].len = 0;
+    }
+
+    int32_t *head = malloc( ( 1 << LZ_HASH_BITS ) * sizeof( int32_t ) );
+    int32_t *prev = malloc( ( len ? len : 1 ) * sizeof( int32_t ) );
+    uint8_t *packed = malloc( huffman_bound( len + 16 ) );
+
+    if ( !head || !prev || !packed || !streams[0].data || !streams[1].data || !streams[2].data || !streams[3].data ) {
+        fprintf( stderr, "Error in LZ compression \n" );
+        exit( EXIT_FAILURE );
+    }
+
+    memset( head, 0xFF, ( 1 << LZ_HASH_BITS ) * sizeof( int32_t ) );
+
+    //! Greedy parse, every position is chained to the previous one with the same hash
+
+    size_t anchor = 0, i = 0;
+
+    while ( i + LZ_MIN_MATCH <= len ) {
+        uint32_t h = hash4( in + i );
+        size_t best_len = 0, best_off = 0;
+
+        int32_t cand = head[h];
+        for ( int depth = 0; cand >= 0 && depth < LZ_CHAIN_DEPTH; depth++ ) {
+            size_t off = i - cand;
+            if ( off > LZ_MAX_OFFSET )
+                break;
+
+            if ( i + best_len < len && in[cand + best_len] == in[i + best_len] ) {
+                size_t m = 0;
+                while ( i + m < len && in[cand + m] == in[i + m] )
+                    m++;
+                if ( m > best_len ) {
+                    best_len = m;
+                    best_off = off;
+                }
+            }
+            cand = prev[cand];
+        }
+
+        if ( best_len < LZ_MIN_MATCH ) {
+            prev[i] = head[h];
+            head[h] = i;
+            i++;
+            continue;
+        }
+
+        put_sequence( streams, in + anchor, i - anchor, best_len, best_off );
+
+        size_t end = i + best_len;
+        for ( ; i < end && i + LZ_MIN_MATCH <= len; i++ ) {
+            h = hash4( in + i );
+            prev[i] = head[h];
+            head[h] = i;
+        }
+        i = end;
+        anchor = i;
+    }
+
+    put_sequence( streams, in + anchor, len - anchor, 0, 0 );
+
+    //! Each stream is Huffman coded only if it gets smaller
+
+    uint8_t *pos = out;
+    for ( int s = 0; s < LZ_STREAMS; s++ ) {
+        LzStreamHeader hdr = { streams[s].len, streams[s].len };
+        size_t coded = streams[s].len ? huffman_encode( streams[s].data, streams[s].len, packed ) : 0;
+
+        const uint8_t *payload = streams[s].data;
+        if ( coded && coded < streams[s].len ) {
+            hdr.len = coded;
+            payload = packed;
+        }
+
+        memcpy( pos, &hdr, sizeof( hdr ) );
+        memcpy( pos + sizeof( hdr ), payload, hdr.len );
+        pos += sizeof( hdr ) + hdr.len;
+
+        free( streams[s].data );
+    }
+
+    free( head );
+    free( prev );
+    free( packed );
+    return pos - out;
+}
+
+// --------------------------------------
+/***** Read a length beyond the 4 bits of the token *****/
+static bool get_length( const uint8_t **pos, const uint8_t *end, size_t *len ) {
+    uint8_t b;
+    do {
+        if ( *pos >= end )
+            return false;
+        b = *( *pos )++;
+        *len += b;
+    } while ( b == 255 );
+    return true;
+}
+
+// --------------------------------------
+/***** Decompression of a block of "out_len" bytes *****/
+bool lz_decode( const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len ) {
+
+    uint8_t *streams[LZ_STREAMS] = { NULL };
+    size_t lens[LZ_STREAMS] = { 0 };
+    bool ok = true;
+
+    const uint8_t *pos = in, *end = in + in_len;
+
+    for ( int s = 0; ok && s < LZ_STREAMS; s++ ) {
+        LzStreamHeader hdr;
+        if ( (size_t)( end - pos ) < sizeof( hdr ) ) {
+            ok = false;
+            break;
+        }
+        memcpy( &hdr, pos, sizeof( hdr ) );
+        pos += sizeof( hdr );
+
+        if ( (size_t)( end - pos ) < hdr.len || hdr.raw_len > out_len + out_len / 2 + 16 ) {
+            ok = false;
+            break;
+        }
+
+        streams[s] = malloc( hdr.raw_len ? hdr.raw_len : 1 );
+        lens[s] = hdr.raw_len;
+
+        if ( !streams[s] )
+            ok = false;
+        else if ( hdr.len == hdr.raw_len )
+            memcpy( streams[s], pos, hdr.len );
+        else
+            ok = huffman_decode( pos, hdr.len, streams[s], hdr.raw_len );
+
+        pos += hdr.len;
+    }
+
+    //! Replay the sequences
+
+    const uint8_t *lit = streams[0], *lit_end = streams[0] + lens[0];
+    const uint8_t *tok = streams[1], *tok_end = streams[1] + lens[1];
+    const uint8_t *extra = streams[2], *extra_end = streams[2] + lens[2];
+    const uint8_t *off = streams[3], *off_end = streams[3] + lens[3];
+    uint8_t *op = out, *op_end = out + out_len;
+
+    while ( ok ) {
+        if ( tok >= tok_end ) {
+            ok = false;
+            break;
+        }
+        uint8_t token = *tok++;
+
+        size_t lit_len = token >> 4;
+        if ( lit_len == 15 && !get_length( &extra, extra_end, &lit_len ) ) {
+            ok = false;
+            break;
+        }
+
+        if ( lit_len > (size_t)( lit_end - lit ) || lit_len > (size_t)( op_end - op ) ) {
+            ok = false;
+            break;
+        }
+        memcpy( op, lit, lit_len );
+        op += lit_len;
+        lit += lit_len;
+
+        if ( op == op_end ) // The last sequence has no match
+            break;
+
+        size_t match_len = token & 0x0F;
+        if ( ( match_len == 15 && !get_length( &extra, extra_end, &match_len ) ) || off_end - off < 2 ) {
+            ok = false;
+            break;
+        }
+        match_len += LZ_MIN_MATCH;
+
+        size_t offset = off[0] | off[1] << 8;
+        off += 2;
+
+        if ( offset == 0 || offset > (size_t)( op - out ) || match_len > (size_t)( op_end - op ) ) {
+            ok = false;
+            break;
+        }
+
+        const uint8_t *src = op - offset;
+        if ( offset >= match_len ) {
+            memcpy( op, src, match_len );
+            op += match_len;
+        } else {
+            for ( size_t k = 0; k < match_len; k++ ) // Overlapping copy
+                *op++ = *src++;
+        }
+    }
+
+    for ( int s = 0; s < LZ_STREAMS; s++ )
+        free( streams[s] );
+
+    return ok && op == op_end;
+}
@@ -0,0 +1,40 @@
+
+/*
+ * #################################################
+ *
+ *              Description:
+ * Header associated with LZ_Coding.c.
+ *
+ *      License:
+ * This program is distributed under the terms of the GNU General Public License (GPL),
+ * ensuring the freedom to redistribute and modify the software in accordance with open-source standards.
+ *
+ *      Author:
+ * Catoni Mirko (IMprojtech)
+ *
+ * #################################################
+ */
+
+#ifndef LZ_CODING_H
+#define LZ_CODING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "Huffman_Coding.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 15
+#define LZ_CHAIN_DEPTH 32 // Candidates tried for each position
+#define LZ_STREAMS 4      // Literals, sequence tokens, extra lengths, offsets
+
+// Compression of independent blocks
+size_t lz_bound( size_t len );
+size_t lz_encode( const uint8_t *in, size_t len, uint8_t *out );
+bool lz_decode( const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len );
+
+#endif // LZ_CODING_H
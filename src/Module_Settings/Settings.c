@@ -28,6 +28,8 @@ static char *trim( char *s );
 static const char *map_symbol( const char *symbol );
 static void parse_style( const char *spec, char *outbuf );
 static void validate_editor( const char *editor );
+static int validate_threads( const char *threads );
+static void validate_codec( const char *codec );
 
 // --------------------------------------
 /***** Trim whitespace; skip full-line or inline comments (# or //) *****/
@@ -119,6 +121,28 @@ static void validate_editor( const char *editor ) {
     }
 }
 
+// --------------------------------------
+/***** Validate threads field *****/
+static int validate_threads( const char *threads ) {
+    char *end;
+    long n = strtol( threads, &end, 10 );
+
+    if ( *end != '\0' || n < 0 || n > 256 ) {
+        fprintf( stderr, "Invalid threads: %s\n", threads );
+        exit( EXIT_FAILURE );
+    }
+    return (int)n;
+}
+
+// --------------------------------------
+/***** Validate codec field *****/
+static void validate_codec( const char *codec ) {
+    if ( strcmp( codec, "huffman" ) && strcmp( codec, "lz" ) ) {
+        fprintf( stderr, "Invalid codec: %s\n", codec );
+        exit( EXIT_FAILURE );
+    }
+}
+
 // --------------------------------------
 /***** Write config and style specs *****/
 void write_config( const char *path, Config *cfg, Style *stl ) {
@@ -136,6 +160,12 @@ void write_config( const char *path, Config *cfg, Style *stl ) {
     fprintf( fp, "\n# Editor  (vim,nano)\n" );
     fprintf( fp, "Editor= %s\n\n", cfg->editor );
 
+    fprintf( fp, "\n# Compression threads (0 = one per core)\n" );
+    fprintf( fp, "Threads= %d\n\n", cfg->threads );
+
+    fprintf( fp, "\n# Codec of new notes files (lz, huffman)\n" );
+    fprintf( fp, "Codec= %s\n\n", cfg->codec );
+
     fprintf( fp, "\n# Style (bold, underline, reset, black, red, green, yellow, blue, magenta, "
                  "cyan, white)\n" );
     fprintf( fp, "Style_Hash= %s\n", stl->color_hash );
@@ -180,6 +210,11 @@ void load_config( const char *path, Config *cfg, Style *stl ) {
         else if ( !strcasecmp( ln, "Editor" ) ) {
             validate_editor( val );
             strcpy( cfg->editor, val );
+        } else if ( !strcasecmp( ln, "Threads" ) )
+            cfg->threads = validate_threads( val );
+        else if ( !strcasecmp( ln, "Codec" ) ) {
+            validate_codec( val );
+            strcpy( cfg->codec, val );
         } else if ( !strcasecmp( ln, "$" ) )
             strcpy( cfg->file_note, val );
         else if ( !strcasecmp( ln, "Style_Tag" ) )
@@ -351,6 +386,8 @@ void update_config_value( const char *command, int index, const char *input,
 void default_config( Config *cfg, Style *stl ) {
 
     strncpy( cfg->editor, "vim", NAME_MAX - 1 );
+    cfg->threads = 0;
+    strncpy( cfg->codec, "lz", NAME_MAX - 1 );
 
     strncpy( stl->color_tag, "bold,yellow", NAME_MAX - 1 );
     strncpy( stl->color_hash, "bold,red", NAME_MAX - 1 );
@@ -56,6 +56,8 @@ typedef struct {
     char hash_pass[HASH_PASS_MAX];
     char editor[NAME_MAX];
     char file_note[VALUE_MAX];
+    int threads;          // Compression workers (0 = one per core)
+    char codec[NAME_MAX]; // Codec of new notes files
 } Config;
 
 // Runtime commands: AddFile, ShowFile, SetFile, Editor
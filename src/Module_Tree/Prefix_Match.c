@@ -0,0 +1,199 @@
+
+/*
+ * #################################################
+ *
+ *      Description:
+ * Prefix search over arrays of fixed-size rows (tags and hashes of the tree).
+ * Each row is compared in one go through a byte mask, with SSE2 or AVX2
+ * when the CPU has them; the implementation is chosen on the first search.
+ *
+ *      License:
+ * This program is distributed under the terms of the GNU General Public License (GPL),
+ * ensuring the freedom to redistribute and modify the software in accordance with open-source standards.
+ *
+ *      Version:  1.0
+ *      Created:  18/07/2025
+ *
+ *      Author:
+ * Catoni Mirko (IMprojtech)
+ *
+ * #################################################
+ */
+
+#include "Prefix_Match.h"
+
+#include <ctype.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define PREFIX_X86
+#endif
+
+// --------------------------------------
+/* Support structures */
+typedef long ( *match_function )( const uint8_t *rows, size_t stride, size_t count, const RowPrefix *prefix,
+                                  size_t from );
+
+// --------------------------------------
+/* Handler declarations */
+static long match_scalar( const uint8_t *rows, size_t stride, size_t count, const RowPrefix *prefix, size_t from );
+static match_function select_match( void );
+
+#ifdef PREFIX_X86
+static long match_sse2( const uint8_t *rows, size_t stride, size_t count, const RowPrefix *prefix, size_t from );
+static long match_avx2( const uint8_t *rows, size_t stride, size_t count, const RowPrefix *prefix, size_t from );
+#endif
+
+// --------------------------------------
+/***** Prefix of text rows *****/
+void prefix_from_text( RowPrefix *prefix, const char *text, size_t len ) {
+    memset( prefix, 0, sizeof( RowPrefix ) );
+
+    if ( len > PREFIX_ROW_MAX )
+        len = PREFIX_ROW_MAX;
+
+    for ( size_t i = 0; i < len; i++ ) {
+        prefix->key[i] = tolower( (unsigned char)text[i] );
+        prefix->mask[i] = 0xFF;
+    }
+    prefix->len = len;
+}
+
+// --------------------------------------
+/***** Prefix of raw rows from hexadecimal digits *****/
+bool prefix_from_hex( RowPrefix *prefix, const char *hex, size_t len ) {
+    memset( prefix, 0, sizeof( RowPrefix ) );
+
+    if ( len > PREFIX_ROW_MAX * 2 )
+        return false;
+
+    //! An odd digit only fixes the high nibble of the last byte
+
+    for ( size_t i = 0; i < len; i++ ) {
+        int c = tolower( (unsigned char)hex[i] ), digit;
+        if ( c >= '0' && c <= '9' )
+            digit = c - '0';
+        else if ( c >= 'a' && c <= 'f' )
+            digit = c - 'a' + 10;
+        else
+            return false;
+
+        prefix->key[i / 2] |= i % 2 ? digit : digit << 4;
+        prefix->mask[i / 2] |= i % 2 ? 0x0F : 0xF0;
+    }
+    prefix->len = ( len + 1 ) / 2;
+    return true;
+}
+
+// --------------------------------------
+/***** One byte at a time *****/
+static long match_scalar( const uint8_t *rows, size_t stride, size_t count, const RowPrefix *prefix, size_t from ) {
+    for ( size_t pos = from; pos < count; pos++ ) {
+        const uint8_t *row = rows + pos * stride;
+
+        size_t i = 0;
+        while ( i < prefix->len && ( row[i] & prefix->mask[i] ) == prefix->key[i] )
+            i++;
+
+        if ( i == prefix->len )
+            return pos;
+    }
+
+    return -1;
+}
+
+#ifdef PREFIX_X86
+
+// --------------------------------------
+/***** One row for each comparison (two if the prefix is longer than 16 bytes) *****/
+__attribute__( ( target( "sse2" ) ) ) static long match_sse2( const uint8_t *rows, size_t stride, size_t count,
+                                                              const RowPrefix *prefix, size_t from ) {
+    if ( stride < 16 )
+        return match_scalar( rows, stride, count, prefix, from );
+
+    //! The second chunk ends with the row and may overlap the first one
+
+    size_t tail = stride - 16;
+    bool two = prefix->len > 16;
+
+    __m128i key0 = _mm_loadu_si128( (const __m128i *)prefix->key );
+    __m128i mask0 = _mm_loadu_si128( (const __m128i *)prefix->mask );
+    __m128i key1 = _mm_loadu_si128( (const __m128i *)( prefix->key + tail ) );
+    __m128i mask1 = _mm_loadu_si128( (const __m128i *)( prefix->mask + tail ) );
+
+    for ( size_t pos = from; pos < count; pos++ ) {
+        const uint8_t *row = rows + pos * stride;
+
+        __m128i eq = _mm_cmpeq_epi8( _mm_and_si128( _mm_loadu_si128( (const __m128i *)row ), mask0 ), key0 );
+        if ( two ) {
+            __m128i chunk = _mm_loadu_si128( (const __m128i *)( row + tail ) );
+            eq = _mm_and_si128( eq, _mm_cmpeq_epi8( _mm_and_si128( chunk, mask1 ), key1 ) );
+        }
+
+        if ( _mm_movemask_epi8( eq ) == 0xFFFF )
+            return pos;
+    }
+
+    return -1;
+}
+
+// --------------------------------------
+/***** Four rows for each comparison when the prefix fits in 8 bytes *****/
+__attribute__( ( target( "avx2" ) ) ) static long match_avx2( const uint8_t *rows, size_t stride, size_t count,
+                                                              const RowPrefix *prefix, size_t from ) {
+    if ( prefix->len > 8 || stride < 8 )
+        return match_sse2( rows, stride, count, prefix, from );
+
+    //! The first 8 bytes of four rows are gathered in a single register
+
+    uint64_t key, mask;
+    memcpy( &key, prefix->key, sizeof( key ) );
+    memcpy( &mask, prefix->mask, sizeof( mask ) );
+
+    __m256i keys = _mm256_set1_epi64x( key );
+    __m256i masks = _mm256_set1_epi64x( mask );
+    __m256i offsets = _mm256_set_epi64x( 3 * stride, 2 * stride, stride, 0 );
+
+    size_t pos = from;
+    for ( ; pos + 4 <= count; pos += 4 ) {
+        const long long *base = (const long long *)( rows + pos * stride );
+        __m256i heads = _mm256_i64gather_epi64( base, offsets, 1 );
+
+        __m256i eq = _mm256_cmpeq_epi64( _mm256_and_si256( heads, masks ), keys );
+
+        int hits = _mm256_movemask_pd( _mm256_castsi256_pd( eq ) );
+        if ( hits )
+            return pos + __builtin_ctz( hits );
+    }
+
+    return match_scalar( rows, stride, count, prefix, pos );
+}
+
+#endif
+
+// --------------------------------------
+/***** Best implementation for this CPU *****/
+static match_function select_match( void ) {
+#ifdef PREFIX_X86
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) )
+        return match_avx2;
+    if ( __builtin_cpu_supports( "sse2" ) )
+        return match_sse2;
+#endif
+    return match_scalar;
+}
+
+// --------------------------------------
+/***** First row from "from" on that starts with the prefix *****/
+long prefix_match( const uint8_t *rows, size_t stride, size_t count, const RowPrefix *prefix, size_t from ) {
+    static match_function match = NULL;
+
+    if ( match == NULL )
+        match = select_match();
+
+    if ( prefix->len > stride )
+        return -1;
+
+    return match( rows, stride, count, prefix, from );
+}
@@ -0,0 +1,44 @@
+
+/*
+ * #################################################
+ *
+ *              Description:
+ * Header associated with Prefix_Match.c.
+ *
+ *      License:
+ * This program is distributed under the terms of the GNU General Public License (GPL),
+ * ensuring the freedom to redistribute and modify the software in accordance with open-source standards.
+ *
+ *      Author:
+ * Catoni Mirko (IMprojtech)
+ *
+ * #################################################
+ */
+
+#ifndef PREFIX_MATCH_H
+#define PREFIX_MATCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PREFIX_ROW_MAX 32 // Widest row that can be matched
+
+typedef struct { //! Prefix compared against rows of fixed size
+    uint8_t key[PREFIX_ROW_MAX];  // Bytes of the prefix, already masked
+    uint8_t mask[PREFIX_ROW_MAX]; // Bits of each byte that take part in the comparison
+    size_t len;                   // Bytes covered by the mask
+} RowPrefix;
+
+// Prefix of text rows (the rows must already be folded to lower case)
+void prefix_from_text( RowPrefix *prefix, const char *text, size_t len );
+
+// Prefix of raw rows from hexadecimal digits (false if "hex" has other characters)
+bool prefix_from_hex( RowPrefix *prefix, const char *hex, size_t len );
+
+// First row from "from" on that starts with the prefix (-1 if none)
+long prefix_match( const uint8_t *rows, size_t stride, size_t count, const RowPrefix *prefix, size_t from );
+
+#endif // PREFIX_MATCH_H
@@ -21,13 +21,64 @@
 
 #include "Tree_Structure.h"
 
+// --------------------------------------
+/* Support structures */
+typedef struct NodeSlab { //! Contiguous block of nodes
+    struct NodeSlab *next;
+    size_t used;
+    size_t capacity;
+    TreeNode nodes[];
+} NodeSlab;
+
+typedef struct { //! Allocator of the nodes
+    NodeSlab *slabs;     // Last slab first
+    TreeNode *free_list; // Removed nodes, linked through nextSibling
+} NodeArena;
+
+static NodeArena arena;
+
+typedef struct { //! Tags stored once, referenced by their offset
+    char *text;       // Tags with their terminator ("" at offset 0)
+    size_t len;
+    size_t capacity;
+    uint32_t *slots;  // Open addressing on the offsets (0 = free)
+    size_t slot_count;
+    size_t used;
+} TagPool;
+
+static TagPool pool;
+
 // --------------------------------------
 /* Handler declarations */
 static void error_tree( const char *msg );
-static void swap_nodes( TreeNode *previous, TreeNode *current, TreeNode *next );
-static void write_tree( FILE *fp, TreeNode *root );
+static TreeNode *alloc_node( void );
+static void release_node( TreeNode *node );
+static uint32_t tag_hash( const char *tag, size_t len );
+static void grow_slots( void );
+static uint32_t intern_tag( const char *tag, size_t len );
+static void set_offsets( BlockInfo *data, int64_t start, int64_t end );
+static void touch_node( TreeNode *node );
+static void link_child( TreeNode *parent, TreeNode *node );
+static void unlink_node( TreeNode *node );
+static void swap_nodes( TreeNode *current, TreeNode *next );
 static TreeNode *read_tree( FILE *fp );
-static int find_delimiter( FILE *fp );
+static TreeNode *read_text_tree( const char *text, size_t len );
+static long find_delimiter( const char *base, size_t size );
+static long count_nodes( TreeNode *root );
+static void *grow_array( void *array, size_t *capacity, size_t needed, size_t size );
+static int compare_hash_nodes( const void *a, const void *b );
+static size_t common_prefix( const char *a, const char *b );
+static int compare_tag_entries( const void *a, const void *b );
+static void *column( size_t count, size_t size );
+static uint32_t tree_checksum( const char *buf, size_t len );
+static void encode_node( const BlockInfo *data, TreeRecord *rec );
+static void decode_node( const TreeRecord *rec, BlockInfo *data );
+static void pack_tree( TreeNode *root, TreeRecord *records, long count );
+static void pack_changes( TreeNode *root, TreeChange *changes );
+static bool read_footer( tree_read_function read, void *ctx, uint64_t end, TreeFooter *footer );
+static const char *read_section( tree_read_function read, void *ctx, const TreeFooter *footer );
+static TreeNode *slot_node( const TreeRecord *records, uint8_t *loaded, uint32_t slots, int64_t slot );
+static TreeNode *build_tree( const TreeRecord *records, uint8_t *loaded, uint32_t slots, uint32_t root );
 
 // --------------------------------------
 /***** Error reporting function *****/
@@ -36,51 +87,344 @@ static void error_tree( const char *msg ) {
     exit( EXIT_FAILURE );
 }
 
+// --------------------------------------
+/***** Take a node from the free list or from the last slab *****/
+static TreeNode *alloc_node( void ) {
+    TreeNode *node = arena.free_list;
+
+    if ( node != NULL ) {
+        arena.free_list = node->nextSibling;
+        return node;
+    }
+
+    NodeSlab *slab = arena.slabs;
+    if ( slab == NULL || slab->used == slab->capacity ) {
+        size_t capacity = slab == NULL ? ARENA_SLAB_MIN : slab->capacity * 2;
+        if ( capacity > ARENA_SLAB_MAX )
+            capacity = ARENA_SLAB_MAX;
+
+        NodeSlab *grown = malloc( sizeof( NodeSlab ) + capacity * sizeof( TreeNode ) );
+        if ( grown == NULL )
+            error_tree( "memory allocation" );
+
+        grown->next = slab;
+        grown->used = 0;
+        grown->capacity = capacity;
+        arena.slabs = slab = grown;
+    }
+
+    return &slab->nodes[slab->used++];
+}
+
+// --------------------------------------
+/***** Give a node back to the arena *****/
+static void release_node( TreeNode *node ) {
+    node->firstChild = NULL;
+    node->nextSibling = arena.free_list;
+    arena.free_list = node;
+}
+
 // --------------------------------------
 /***** Free memory *****/
 void free_tree( TreeNode *root ) {
 
-    if ( root == NULL ) {
+    //! The children are moved ahead of the siblings, so the nodes form a single list
+
+    TreeNode *node = root;
+    while ( node != NULL ) {
+        TreeNode *next = node->nextSibling;
+
+        if ( node->firstChild != NULL ) {
+            node->lastChild->nextSibling = next;
+            next = node->firstChild;
+        }
+
+        release_node( node );
+        node = next;
+    }
+}
+
+// --------------------------------------
+/***** Release every node and tag at once *****/
+void free_tree_arena( void ) {
+    while ( arena.slabs != NULL ) {
+        NodeSlab *next = arena.slabs->next;
+        free( arena.slabs );
+        arena.slabs = next;
+    }
+    arena.free_list = NULL;
+
+    free( pool.text );
+    free( pool.slots );
+    memset( &pool, 0, sizeof( TagPool ) );
+}
+
+//----- Node data -----
+
+// --------------------------------------
+/***** Hash of a tag for the pool (FNV-1a) *****/
+static uint32_t tag_hash( const char *tag, size_t len ) {
+    uint32_t h = 2166136261u;
+    for ( size_t i = 0; i < len; i++ )
+        h = ( h ^ (uint8_t)tag[i] ) * 16777619u;
+    return h;
+}
+
+// --------------------------------------
+/***** Double the slots of the pool *****/
+static void grow_slots( void ) {
+    size_t count = pool.slot_count ? pool.slot_count * 2 : 64;
+    uint32_t *slots = calloc( count, sizeof( uint32_t ) );
+    if ( slots == NULL )
+        error_tree( "memory allocation" );
+
+    for ( size_t i = 0; i < pool.slot_count; i++ ) {
+        uint32_t offset = pool.slots[i];
+        if ( offset == 0 )
+            continue;
+
+        const char *tag = pool.text + offset;
+        size_t slot = tag_hash( tag, strlen( tag ) ) & ( count - 1 );
+        while ( slots[slot] != 0 )
+            slot = ( slot + 1 ) & ( count - 1 );
+        slots[slot] = offset;
+    }
+
+    free( pool.slots );
+    pool.slots = slots;
+    pool.slot_count = count;
+}
+
+// --------------------------------------
+/***** Offset of a tag, added to the pool the first time it is seen *****/
+static uint32_t intern_tag( const char *tag, size_t len ) {
+    if ( len == 0 )
+        return 0;
+
+    if ( pool.text == NULL ) {
+        pool.capacity = 256;
+        pool.text = malloc( pool.capacity );
+        if ( pool.text == NULL )
+            error_tree( "memory allocation" );
+        pool.text[0] = '\0';
+        pool.len = 1;
+    }
+
+    if ( ( pool.used + 1 ) * 2 > pool.slot_count )
+        grow_slots();
+
+    size_t mask = pool.slot_count - 1;
+    size_t slot = tag_hash( tag, len ) & mask;
+
+    for ( ; pool.slots[slot] != 0; slot = ( slot + 1 ) & mask ) {
+        const char *stored = pool.text + pool.slots[slot];
+        if ( strncmp( stored, tag, len ) == 0 && stored[len] == '\0' )
+            return pool.slots[slot];
+    }
+
+    //! New tag at the end of the text
+
+    if ( pool.len + len + 1 >= UINT32_MAX )
+        error_tree( "too many tags" );
+
+    if ( pool.len + len + 1 > pool.capacity ) {
+        while ( pool.len + len + 1 > pool.capacity )
+            pool.capacity *= 2;
+        pool.text = realloc( pool.text, pool.capacity );
+        if ( pool.text == NULL )
+            error_tree( "memory allocation" );
+    }
+
+    uint32_t offset = pool.len;
+    memcpy( pool.text + offset, tag, len );
+    pool.text[offset + len] = '\0';
+    pool.len += len + 1;
+
+    pool.slots[slot] = offset;
+    pool.used++;
+    return offset;
+}
+
+// --------------------------------------
+/***** Tag of a node *****/
+const char *block_tag( const BlockInfo *data ) {
+    return pool.text ? pool.text + data->tag : "";
+}
+
+// --------------------------------------
+/***** Set the tag of a node *****/
+void block_set_tag( BlockInfo *data, const char *tag ) {
+    data->tag = intern_tag( tag, strnlen( tag, TREE_TAG_SIZE - 1 ) );
+    data->flags |= TREE_CHANGED;
+}
+
+// --------------------------------------
+/***** Hash in hexadecimal *****/
+char *block_hash( const BlockInfo *data, char text[TREE_HASH_TEXT] ) {
+    if ( !( data->flags & TREE_HAS_HASH ) ) {
+        strcpy( text, "." );
+        return text;
+    }
+
+    static const char digits[] = "0123456789abcdef";
+    for ( int i = 0; i < TREE_HASH_SIZE; i++ ) {
+        text[i * 2] = digits[data->hash[i] >> 4];
+        text[i * 2 + 1] = digits[data->hash[i] & 0x0F];
+    }
+    text[TREE_HASH_SIZE * 2] = '\0';
+    return text;
+}
+
+// --------------------------------------
+/***** Set the hash from hexadecimal digits *****/
+void block_set_hash( BlockInfo *data, const char *text ) {
+    RowPrefix digits;
+
+    data->flags &= ~TREE_HAS_HASH;
+    data->flags |= TREE_CHANGED;
+    memset( data->hash, 0, TREE_HASH_SIZE );
+
+    if ( strlen( text ) != TREE_HASH_SIZE * 2 || !prefix_from_hex( &digits, text, TREE_HASH_SIZE * 2 ) )
         return;
+
+    memcpy( data->hash, digits.key, TREE_HASH_SIZE );
+    data->flags |= TREE_HAS_HASH;
+}
+
+// --------------------------------------
+/***** Date as TREE_DATE_FORMAT *****/
+char *block_date( const BlockInfo *data, char text[TREE_DATE_TEXT] ) {
+    if ( !( data->flags & TREE_HAS_DATE ) ) {
+        strcpy( text, "." );
+        return text;
     }
 
-    free_tree( root->firstChild );
-    free_tree( root->nextSibling );
-    free( root );
-    root = NULL;
+    struct tm tm;
+    time_t date = data->date;
+    gmtime_r( &date, &tm );
+    strftime( text, TREE_DATE_TEXT, TREE_DATE_FORMAT, &tm );
+    return text;
 }
 
-//----- Node Checks -----
+// --------------------------------------
+/***** Set the date from TREE_DATE_FORMAT *****/
+void block_set_date( BlockInfo *data, const char *text ) {
+    struct tm tm = { 0 };
+    const char *end = strptime( text, TREE_DATE_FORMAT, &tm );
+
+    data->flags &= ~TREE_HAS_DATE;
+    data->flags |= TREE_CHANGED;
+    data->date = 0;
+
+    if ( end != NULL && *end == '\0' ) {
+        data->date = timegm( &tm );
+        data->flags |= TREE_HAS_DATE;
+    }
+}
+
+// --------------------------------------
+/***** Set the offsets of the record *****/
+void block_set_record( BlockInfo *data, uint32_t start, uint32_t end ) {
+    data->start = start;
+    data->end = end;
+    data->flags |= TREE_CHANGED;
+}
 
 // --------------------------------------
-/***** Auxiliary function to check for duplicate tags in the tree *****/
-void check_duplicate( TreeNode *root, char *key, find_function find, int *cont ) {
-    if ( root == NULL ) {
+/***** Offsets read from a stored structure (end -1 = no record) *****/
+static void set_offsets( BlockInfo *data, int64_t start, int64_t end ) {
+    if ( end == -1 ) {
+        data->start = 0;
+        data->end = BLOCK_NO_RECORD;
         return;
     }
 
-    if ( find( root, key ) == 0 ) {
-        ( *cont )++;
+    if ( start < 0 || end < 0 || start >= BLOCK_NO_RECORD || end >= BLOCK_NO_RECORD )
+        error_tree( "tree corrupted" );
+
+    data->start = start;
+    data->end = end;
+}
+
+//----- Traversal -----
+
+// --------------------------------------
+/***** Start a preorder walk *****/
+void tree_iter_init( TreeIter *it, TreeNode *root, bool siblings ) {
+    it->next = root;
+    it->next_depth = 0;
+    it->depth = 0;
+    it->siblings = siblings;
+}
+
+// --------------------------------------
+/***** Next node in preorder *****/
+TreeNode *tree_iter_next( TreeIter *it ) {
+    TreeNode *node = it->next;
+    if ( node == NULL )
+        return NULL;
+
+    it->depth = it->next_depth;
+
+    //! Down to the first child, otherwise up until a node has a following sibling
+
+    TreeNode *up = node;
+    int depth = it->depth;
+
+    if ( node->firstChild != NULL ) {
+        it->next = node->firstChild;
+        it->next_depth = depth + 1;
+        return node;
+    }
+
+    it->next = NULL;
+    while ( depth > 0 || it->siblings ) {
+        if ( up->nextSibling != NULL ) {
+            it->next = up->nextSibling;
+            it->next_depth = depth;
+            break;
+        }
+        if ( depth == 0 )
+            break;
+
+        up = up->parent;
+        depth--;
     }
 
-    check_duplicate( root->firstChild, key, find, cont );
-    check_duplicate( root->nextSibling, key, find, cont );
+    return node;
 }
 
+// --------------------------------------
+/***** Grows a heap array to hold "needed" items *****/
+static void *grow_array( void *array, size_t *capacity, size_t needed, size_t size ) {
+    if ( needed <= *capacity )
+        return array;
+
+    size_t grown = *capacity ? *capacity : 64;
+    while ( grown < needed )
+        grown *= 2;
+
+    array = realloc( array, grown * size );
+    if ( array == NULL )
+        error_tree( "memory allocation" );
+
+    *capacity = grown;
+    return array;
+}
+
+//----- Node Checks -----
+
 // --------------------------------------
 /***** Auxiliary function to check if a node is a descendant of another node *****/
 int is_descendant( TreeNode *potentialDescendant, TreeNode *ancestor ) {
     if ( ancestor == NULL )
         return 0;
 
-    if ( ancestor == potentialDescendant )
-        return 1;
+    //! Walk up from the candidate, the depth bounds the cost
 
-    TreeNode *child = ancestor->firstChild;
-    while ( child != NULL ) {
-        if ( is_descendant( potentialDescendant, child ) )
+    for ( TreeNode *node = potentialDescendant; node != NULL; node = node->parent ) {
+        if ( node == ancestor )
             return 1;
-        child = child->nextSibling;
     }
 
     return 0;
@@ -91,211 +435,489 @@ int is_descendant( TreeNode *potentialDescendant, TreeNode *ancestor ) {
 // --------------------------------------
 /***** Search tags *****/
 int find_tag_node( TreeNode *node, char *tag ) {
-    return strncasecmp( node->data.tag, tag, strlen( tag ) );
+    return strncasecmp( block_tag( &node->data ), tag, strlen( tag ) );
 }
 
 // --------------------------------------
 /***** Search hash *****/
 int find_hash_node( TreeNode *node, char *hash ) {
-    return strncasecmp( node->data.hash, hash, strlen( hash ) );
+    char text[TREE_HASH_TEXT];
+    return strncasecmp( block_hash( &node->data, text ), hash, strlen( hash ) );
 }
 
 // --------------------------------------
 /***** Search date *****/
 int find_date_node( TreeNode *node, char *date ) {
-    return strncasecmp( node->data.date, date, strlen( date ) );
+    char text[TREE_DATE_TEXT];
+    return strncasecmp( block_date( &node->data, text ), date, strlen( date ) );
 }
 
+//----- Hash index -----
+
 // --------------------------------------
-/***** Search node *****/
-TreeNode *find_node( TreeNode *root, char *key, find_function find ) {
-    if ( root == NULL ) {
-        return NULL;
+/***** Order of the index (the same as the hexadecimal hashes, "." first) *****/
+static int compare_hash_nodes( const void *a, const void *b ) {
+    const BlockInfo *da = &( *(TreeNode *const *)a )->data, *db = &( *(TreeNode *const *)b )->data;
+    bool ha = da->flags & TREE_HAS_HASH, hb = db->flags & TREE_HAS_HASH;
+
+    if ( ha != hb )
+        return ha ? 1 : -1;
+    return ha ? memcmp( da->hash, db->hash, TREE_HASH_SIZE ) : 0;
+}
+
+// --------------------------------------
+/***** Sort the nodes of the tree by hash *****/
+void hash_index_build( HashIndex *index, TreeNode *root ) {
+    long count = count_nodes( root );
+
+    free( index->nodes );
+    index->nodes = malloc( ( count ? count : 1 ) * sizeof( TreeNode * ) );
+    if ( index->nodes == NULL )
+        error_tree( "memory allocation" );
+
+    TreeIter it;
+    TreeNode *node;
+
+    index->count = 0;
+    tree_iter_init( &it, root, true );
+    while ( ( node = tree_iter_next( &it ) ) != NULL )
+        index->nodes[index->count++] = node;
+
+    qsort( index->nodes, index->count, sizeof( TreeNode * ), compare_hash_nodes );
+}
+
+// --------------------------------------
+/***** Free the index *****/
+void hash_index_free( HashIndex *index ) {
+    free( index->nodes );
+    index->nodes = NULL;
+    index->count = 0;
+}
+
+// --------------------------------------
+/***** Search the nodes whose hash starts with "prefix" *****/
+HashLookup hash_index_find( const HashIndex *index, const char *prefix, TreeNode **found ) {
+    size_t len = strlen( prefix );
+    size_t low = 0, high = index->count;
+    char text[TREE_HASH_TEXT];
+
+    //! The matches are adjacent, starting from the first hash not below the prefix
+
+    while ( low < high ) {
+        size_t mid = low + ( high - low ) / 2;
+        block_hash( &index->nodes[mid]->data, text );
+        if ( strncasecmp( text, prefix, len ) < 0 )
+            low = mid + 1;
+        else
+            high = mid;
     }
 
-    if ( find( root, key ) == 0 ) {
-        return root;
+    *found = NULL;
+    if ( low == index->count )
+        return HASH_NOT_FOUND;
+
+    block_hash( &index->nodes[low]->data, text );
+    if ( strncasecmp( text, prefix, len ) != 0 )
+        return HASH_NOT_FOUND;
+
+    *found = index->nodes[low];
+    if ( low + 1 < index->count ) {
+        block_hash( &index->nodes[low + 1]->data, text );
+        if ( strncasecmp( text, prefix, len ) == 0 )
+            return HASH_AMBIGUOUS;
+    }
+
+    return HASH_UNIQUE;
+}
+
+// --------------------------------------
+/***** Length of the common prefix of two hashes (without case) *****/
+static size_t common_prefix( const char *a, const char *b ) {
+    size_t len = 0;
+    while ( a[len] && tolower( (unsigned char)a[len] ) == tolower( (unsigned char)b[len] ) )
+        len++;
+    return len;
+}
+
+// --------------------------------------
+/***** Shortest prefix that identifies the hash of "node" *****/
+int hash_index_prefix( const HashIndex *index, const TreeNode *node ) {
+    TreeNode *found;
+    char text[TREE_HASH_TEXT], other[TREE_HASH_TEXT];
+
+    block_hash( &node->data, text );
+    int len = strlen( text );
+
+    if ( hash_index_find( index, text, &found ) != HASH_UNIQUE )
+        return len;
+
+    //! Only the neighbours in the index can share a longer prefix
+
+    size_t pos = 0, high = index->count;
+    while ( pos < high ) {
+        size_t mid = pos + ( high - pos ) / 2;
+        if ( compare_hash_nodes( &index->nodes[mid], &node ) < 0 )
+            pos = mid + 1;
+        else
+            high = mid;
     }
 
-    TreeNode *result = find_node( root->firstChild, key, find );
-    if ( result == NULL ) {
-        result = find_node( root->nextSibling, key, find );
+    size_t shared = 0;
+    if ( pos > 0 ) {
+        block_hash( &index->nodes[pos - 1]->data, other );
+        shared = common_prefix( text, other );
+    }
+    if ( pos + 1 < index->count ) {
+        block_hash( &index->nodes[pos + 1]->data, other );
+        size_t next = common_prefix( text, other );
+        if ( next > shared )
+            shared = next;
     }
 
-    return result;
+    return (int)shared + 1 < len ? (int)shared + 1 : len;
 }
 
+//----- Tag index -----
+
 // --------------------------------------
-/***** Search previous sibling *****/
-TreeNode *find_previous_sibling( TreeNode *root, TreeNode *node ) {
+/***** Order of the index (tags compared without case, then preorder) *****/
+static int compare_tag_entries( const void *a, const void *b ) {
+    const TagEntry *ea = a, *eb = b;
+    int cmp = strcasecmp( block_tag( &ea->node->data ), block_tag( &eb->node->data ) );
+
+    if ( cmp != 0 )
+        return cmp;
+    return ( ea->order > eb->order ) - ( ea->order < eb->order );
+}
 
-    if ( root == NULL ) {
-        return NULL;
+// --------------------------------------
+/***** Sort the nodes of the tree by tag *****/
+void tag_index_build( TagIndex *index, TreeNode *root ) {
+    long count = count_nodes( root );
+
+    free( index->entries );
+    index->entries = malloc( ( count ? count : 1 ) * sizeof( TagEntry ) );
+    if ( index->entries == NULL )
+        error_tree( "memory allocation" );
+
+    TreeIter it;
+    TreeNode *node;
+
+    index->count = 0;
+    tree_iter_init( &it, root, true );
+    while ( ( node = tree_iter_next( &it ) ) != NULL ) {
+        index->entries[index->count].node = node;
+        index->entries[index->count].order = index->count;
+        index->count++;
     }
 
-    if ( root->nextSibling == node || root->firstChild == node ) {
-        return root;
+    qsort( index->entries, index->count, sizeof( TagEntry ), compare_tag_entries );
+}
+
+// --------------------------------------
+/***** Free the index *****/
+void tag_index_free( TagIndex *index ) {
+    free( index->entries );
+    index->entries = NULL;
+    index->count = 0;
+}
+
+// --------------------------------------
+/***** Count the nodes whose tag starts with "prefix" *****/
+size_t tag_index_find( const TagIndex *index, const char *prefix, TreeNode **found ) {
+    size_t len = strlen( prefix );
+    size_t low = 0, high = index->count;
+
+    //! The matches are adjacent, starting from the first tag not below the prefix
+
+    while ( low < high ) {
+        size_t mid = low + ( high - low ) / 2;
+        if ( strncasecmp( block_tag( &index->entries[mid].node->data ), prefix, len ) < 0 )
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    const TagEntry *first = NULL;
+    size_t matches = 0;
+
+    for ( size_t i = low; i < index->count; i++, matches++ ) {
+        const TagEntry *entry = &index->entries[i];
+        if ( strncasecmp( block_tag( &entry->node->data ), prefix, len ) != 0 )
+            break;
+        if ( first == NULL || entry->order < first->order )
+            first = entry;
+    }
+
+    *found = first ? first->node : NULL;
+    return matches;
+}
+
+//----- Metadata columns -----
+
+// --------------------------------------
+/***** Allocate a column *****/
+static void *column( size_t count, size_t size ) {
+    void *array = malloc( ( count ? count : 1 ) * size );
+    if ( array == NULL )
+        error_tree( "memory allocation" );
+    return array;
+}
+
+// --------------------------------------
+/***** Lay out the metadata of the tree in preorder *****/
+void tree_columns_build( TreeColumns *cols, TreeNode *root ) {
+    long count = count_nodes( root );
+
+    tree_columns_free( cols );
+    cols->nodes = column( count, sizeof( *cols->nodes ) );
+    cols->depth = column( count, sizeof( *cols->depth ) );
+    cols->tags = column( count, sizeof( *cols->tags ) );
+    cols->hashes = column( count, sizeof( *cols->hashes ) );
+    cols->dates = column( count, sizeof( *cols->dates ) );
+    cols->start = column( count, sizeof( *cols->start ) );
+    cols->end = column( count, sizeof( *cols->end ) );
+    cols->flags = column( count, sizeof( *cols->flags ) );
+
+    TreeIter it;
+    TreeNode *node;
+    TreeRecord rec;
+
+    //! Hashes and dates are converted as in the binary structure
+
+    tree_iter_init( &it, root, true );
+    while ( ( node = tree_iter_next( &it ) ) != NULL ) {
+        size_t pos = cols->count++;
+        encode_node( &node->data, &rec );
+
+        cols->nodes[pos] = node;
+        cols->depth[pos] = it.depth;
+        for ( size_t i = 0; i < sizeof( cols->tags[pos] ); i++ )
+            cols->tags[pos][i] = tolower( (unsigned char)rec.tag[i] );
+        memcpy( cols->hashes[pos], rec.hash, TREE_HASH_SIZE );
+        cols->dates[pos] = rec.date;
+        cols->start[pos] = node->data.start;
+        cols->end[pos] = node->data.end;
+        cols->flags[pos] = rec.flags;
+    }
+}
+
+// --------------------------------------
+/***** Free the columns *****/
+void tree_columns_free( TreeColumns *cols ) {
+    free( cols->nodes );
+    free( cols->depth );
+    free( cols->tags );
+    free( cols->hashes );
+    free( cols->dates );
+    free( cols->start );
+    free( cols->end );
+    free( cols->flags );
+    memset( cols, 0, sizeof( TreeColumns ) );
+}
+
+// --------------------------------------
+/***** Position of the next node that satisfies "find" *****/
+long tree_columns_find( const TreeColumns *cols, char *key, find_function find, long from ) {
+    size_t len = strlen( key );
+    RowPrefix prefix;
+
+    //! Tags and hashes are matched on the columns, any other search on the nodes
+
+    if ( find == find_tag_node ) {
+        if ( len >= sizeof( cols->tags[0] ) )
+            return -1;
+
+        prefix_from_text( &prefix, key, len );
+        return prefix_match( (const uint8_t *)cols->tags, sizeof( cols->tags[0] ), cols->count, &prefix, from );
+    }
+
+    if ( find == find_hash_node && len > 0 && prefix_from_hex( &prefix, key, len ) ) {
+        if ( len > TREE_HASH_SIZE * 2 )
+            return -1;
+
+        //! Nodes without a binary hash only carry "." and never match hexadecimal digits
+
+        const uint8_t *hashes = (const uint8_t *)cols->hashes;
+        long pos = from;
+
+        while ( ( pos = prefix_match( hashes, TREE_HASH_SIZE, cols->count, &prefix, pos ) ) >= 0 ) {
+            if ( cols->flags[pos] & TREE_HAS_HASH )
+                return pos;
+            pos++;
+        }
+        return -1;
     }
 
-    TreeNode *result = find_previous_sibling( root->firstChild, node );
-    if ( result == NULL ) {
-        result = find_previous_sibling( root->nextSibling, node );
+    for ( size_t pos = from; pos < cols->count; pos++ ) {
+        if ( find( cols->nodes[pos], key ) == 0 )
+            return pos;
     }
 
-    return result;
+    return -1;
 }
 
 //----- Tree management -----
 
+// --------------------------------------
+/***** Mark a node whose record has to be saved again *****/
+static void touch_node( TreeNode *node ) {
+    if ( node != NULL )
+        node->data.flags |= TREE_CHANGED;
+}
+
+// --------------------------------------
+/***** Append "node" to the children of "parent" *****/
+static void link_child( TreeNode *parent, TreeNode *node ) {
+    touch_node( node );
+    touch_node( parent->lastChild ? parent->lastChild : parent );
+
+    node->parent = parent;
+    node->prevSibling = parent->lastChild;
+    node->nextSibling = NULL;
+
+    if ( parent->lastChild == NULL )
+        parent->firstChild = node;
+    else
+        parent->lastChild->nextSibling = node;
+
+    parent->lastChild = node;
+}
+
+// --------------------------------------
+/***** Detach "node" (with its descendants) from its parent and siblings *****/
+static void unlink_node( TreeNode *node ) {
+    TreeNode *parent = node->parent;
+
+    touch_node( node );
+    touch_node( node->prevSibling ? node->prevSibling : parent );
+
+    if ( node->prevSibling )
+        node->prevSibling->nextSibling = node->nextSibling;
+    else if ( parent )
+        parent->firstChild = node->nextSibling;
+
+    if ( node->nextSibling )
+        node->nextSibling->prevSibling = node->prevSibling;
+    else if ( parent )
+        parent->lastChild = node->prevSibling;
+
+    node->parent = NULL;
+    node->prevSibling = NULL;
+    node->nextSibling = NULL;
+}
+
 // --------------------------------------
 /***** Insert new node *****/
 TreeNode *insert_node( TreeNode *currentNode, const BlockInfo *data ) {
 
-    TreeNode *newNode = (TreeNode *)malloc( sizeof( TreeNode ) );
+    TreeNode *newNode = alloc_node();
 
     newNode->data = *data;
+    newNode->data.slot = TREE_NO_SLOT;
+    newNode->data.flags |= TREE_CHANGED;
     newNode->firstChild = NULL;
     newNode->nextSibling = NULL;
+    newNode->parent = NULL;
+    newNode->prevSibling = NULL;
+    newNode->lastChild = NULL;
 
     if ( currentNode == NULL ) {
         return newNode;
     }
 
-    if ( currentNode->firstChild == NULL ) {
-        currentNode->firstChild = newNode;
-    }
-
-    else {
-        TreeNode *sibling = currentNode->firstChild;
-        while ( sibling->nextSibling != NULL ) {
-            sibling = sibling->nextSibling;
-        }
-        sibling->nextSibling = newNode;
-    }
+    link_child( currentNode, newNode );
     return currentNode;
 }
 
 // --------------------------------------
 /***** Remove node and its descendants *****/
-TreeNode *remove_node( TreeNode *root, char *hash ) {
-
-    if ( root == NULL ) {
-        return NULL;
-    }
+TreeNode *remove_node( TreeNode *root, TreeNode *node ) {
 
-    if ( strncasecmp( root->data.hash, hash, strlen( hash ) ) == 0 ) {
-        TreeNode *newRoot = root->nextSibling;
-        free( root );
-        return newRoot;
-    }
-
-    TreeNode *currentSibling = root;
-    TreeNode *previousSibling = NULL;
-
-    while ( currentSibling != NULL &&
-            strncasecmp( currentSibling->data.hash, hash, strlen( hash ) ) != 0 ) {
-        previousSibling = currentSibling;
-        currentSibling = currentSibling->nextSibling;
+    if ( node == NULL ) {
+        return root;
     }
 
-    if ( currentSibling != NULL ) {
-        if ( previousSibling != NULL ) {
-            previousSibling->nextSibling = currentSibling->nextSibling;
-        }
-        free( currentSibling );
+    if ( node == root ) {
+        root = node->nextSibling;
     }
 
-    root->firstChild = remove_node( root->firstChild, hash );
-    root->nextSibling = remove_node( root->nextSibling, hash );
+    unlink_node( node );
+    free_tree( node->firstChild );
+    release_node( node );
 
     return root;
 }
 
 // --------------------------------------
-/***** Copy sub tree *****/
-TreeNode *copy_subtree( TreeNode *subtree ) {
-    if ( subtree == NULL ) {
-        return NULL;
-    }
+/***** Exchange a node with the sibling that follows it *****/
+static void swap_nodes( TreeNode *current, TreeNode *next ) {
+    if ( current == NULL || next == NULL )
+        error_tree( "unable to move the node" );
 
-    TreeNode *copy = malloc( sizeof( TreeNode ) );
-    copy->data = subtree->data;
-    copy->firstChild = copy_subtree( subtree->firstChild );
-    copy->nextSibling = copy_subtree( subtree->nextSibling );
+    TreeNode *parent = current->parent;
+    TreeNode *before = current->prevSibling;
+    TreeNode *after = next->nextSibling;
 
-    return copy;
-}
+    touch_node( current );
+    touch_node( next );
+    touch_node( before ? before : parent );
 
-// --------------------------------------
-/***** Exchange node *****/
-static void swap_nodes( TreeNode *previous, TreeNode *current, TreeNode *next ) {
-    if ( current == NULL || next == NULL )
-        error_tree( "unable to move the node" );
+    next->prevSibling = before;
+    next->nextSibling = current;
+    current->prevSibling = next;
+    current->nextSibling = after;
 
-    if ( previous->firstChild == current ) {
-        current->nextSibling = next->nextSibling;
-        next->nextSibling = current;
-        previous->firstChild = next;
-    } else {
-        current->nextSibling = next->nextSibling;
-        next->nextSibling = current;
-        previous->nextSibling = next;
-    }
+    if ( before )
+        before->nextSibling = next;
+    else if ( parent )
+        parent->firstChild = next;
+
+    if ( after )
+        after->prevSibling = current;
+    else if ( parent )
+        parent->lastChild = current;
 }
 
 // --------------------------------------
 /***** Move node *****/
-TreeNode *move_node( TreeNode *root, char *keyDestination, char *keySource, find_function find ) {
-
-    TreeNode *sourceNode = find_node( root, keySource, find );
+TreeNode *move_node( TreeNode *root, char *keyDestination, TreeNode *sourceNode, const HashIndex *index ) {
 
     if ( sourceNode == NULL )
         error_tree( "source node no found" );
 
     if ( strncasecmp( keyDestination, "up", strlen( keyDestination ) ) == 0 ) { // Move Up
-        TreeNode *previusNode = find_previous_sibling( root, sourceNode );
-        TreeNode *previuspreviusNode = find_previous_sibling( root, previusNode );
 
-        if ( previusNode == NULL || previusNode->firstChild == sourceNode )
+        if ( sourceNode->prevSibling == NULL )
             error_tree( "unable to move the node" );
 
-        swap_nodes( previuspreviusNode, previusNode, sourceNode );
+        swap_nodes( sourceNode->prevSibling, sourceNode );
 
     } else if ( strncasecmp( keyDestination, "down",
                              strlen( keyDestination ) ) == 0 ) { // Move Down
-        TreeNode *previusNode = find_previous_sibling( root, sourceNode );
 
         if ( sourceNode->nextSibling == NULL )
             error_tree( "unable to move the node" );
 
-        swap_nodes( previusNode, sourceNode, sourceNode->nextSibling );
+        swap_nodes( sourceNode, sourceNode->nextSibling );
     } else {
 
-        TreeNode *nodeDestination = find_node( root, keyDestination, find );
+        TreeNode *nodeDestination;
 
-        if ( nodeDestination == NULL )
+        if ( hash_index_find( index, keyDestination, &nodeDestination ) != HASH_UNIQUE )
             error_tree( "destination node no found destination" );
 
         if ( is_descendant( nodeDestination, sourceNode ) ) {
             error_tree( "unable to move the node" );
         }
 
-        TreeNode *newNode = malloc( sizeof( TreeNode ) );
-        newNode->data = sourceNode->data;
-        newNode->firstChild = copy_subtree( sourceNode->firstChild );
-        newNode->nextSibling = NULL;
+        //! The subtree keeps its nodes, only the links around the source change
 
-        root = remove_node( root, keySource );
+        if ( sourceNode == root )
+            root = sourceNode->nextSibling;
 
-        if ( nodeDestination->firstChild == NULL ) {
-            nodeDestination->firstChild = newNode;
-        } else {
-            TreeNode *sibling = nodeDestination->firstChild;
-            while ( sibling->nextSibling != NULL ) {
-                sibling = sibling->nextSibling;
-            }
-            sibling->nextSibling = newNode;
-        }
+        unlink_node( sourceNode );
+        link_child( nodeDestination, sourceNode );
     }
 
     return root;
@@ -304,46 +926,49 @@ TreeNode *move_node( TreeNode *root, char *keyDestination, char *keySource, find
 //----- Save and load tree -----
 
 // --------------------------------------
-/***** Write structure *****/
-static void write_tree( FILE *fp, TreeNode *root ) {
-    if ( root == NULL ) {
-        fprintf( fp, "%s\n", STRNODENULL );
-        return;
-    }
-
-    fprintf( fp, "%s\n%ld %ld %s %s %s\n", STRNODE, root->data.start, root->data.end,
-             root->data.hash, root->data.tag, root->data.date );
-    write_tree( fp, root->firstChild );
-    write_tree( fp, root->nextSibling );
-}
-
-// --------------------------------------
-/***** Read_structure *****/
+/***** Read_structure (legacy text format) *****/
 static TreeNode *read_tree( FILE *fp ) {
     BlockInfo data;
     char opt[8];
 
-    if ( fscanf( fp, "%7s", opt ) != 1 ) {
-        return NULL;
-    }
+    //! Every node read leaves two slots, its first child then its next sibling
 
-    if ( strcmp( opt, STRNODENULL ) == 0 ) {
-        return NULL;
-    }
+    typedef struct {
+        TreeNode *owner; // NULL for the root
+        bool child;      // Slot of the first child of "owner", otherwise of its next sibling
+    } Slot;
+
+    Slot *slots = NULL;
+    size_t capacity = 0, count = 0;
+    TreeNode *root = NULL;
+
+    slots = grow_array( slots, &capacity, 1, sizeof( Slot ) );
+    slots[count++] = ( Slot ){ NULL, false };
 
-    if ( strcmp( opt, STRNODE ) == 0 ) {
-        char buff[64];
-        if ( fscanf( fp, "%ld %ld %40s %[^\n]", &data.start, &data.end, data.hash, buff ) != 4 ) {
-            return NULL;
+    while ( count > 0 ) {
+        Slot slot = slots[--count];
+
+        if ( fscanf( fp, "%7s", opt ) != 1 ) {
+            break;
+        }
+
+        if ( strcmp( opt, STRNODE ) != 0 ) {
+            continue;
+        }
+
+        char buff[64], hash[TREE_HASH_TEXT], tag[TREE_TAG_SIZE] = "", date[TREE_DATE_TEXT] = ".";
+        long first, last; // Offsets of the record
+        if ( fscanf( fp, "%ld %ld %40s %[^\n]", &first, &last, hash, buff ) != 4 ) {
+            continue;
         }
 
         if ( strlen( buff ) == 3 ) // root
-            sscanf( buff, "%23s %19[^\n]", data.tag, data.date );
+            sscanf( buff, "%23s %19[^\n]", tag, date );
 
         else {
             size_t bl = strlen( buff );
-            memcpy( data.date, buff + bl - 19, 19 );
-            data.date[19] = '\0';
+            memcpy( date, buff + bl - 19, 19 );
+            date[19] = '\0';
 
             size_t taglen = bl - 19 - 1;
             char temp_tag[24];
@@ -360,81 +985,461 @@ static TreeNode *read_tree( FILE *fp ) {
                 end--;
             }
 
-            strncpy( data.tag, start, sizeof( data.tag ) - 1 );
-            data.tag[sizeof( data.tag ) - 1] = '\0';
+            strncpy( tag, start, sizeof( tag ) - 1 );
+            tag[sizeof( tag ) - 1] = '\0';
         }
-        TreeNode *root = insert_node( NULL, &data );
 
-        if ( root == NULL ) {
+        memset( &data, 0, sizeof( data ) );
+        set_offsets( &data, first, last );
+        block_set_tag( &data, tag );
+        block_set_hash( &data, hash );
+        block_set_date( &data, date );
+        TreeNode *node = insert_node( NULL, &data );
+
+        if ( node == NULL ) {
             error_tree( "node not inserted" );
         }
 
-        root->firstChild = read_tree( fp );
-        root->nextSibling = read_tree( fp );
-        return root;
+        if ( slot.owner == NULL ) {
+            root = node;
+        } else if ( slot.child ) {
+            link_child( slot.owner, node );
+        } else {
+            slot.owner->nextSibling = node;
+            node->prevSibling = slot.owner;
+            node->parent = slot.owner->parent;
+            if ( node->parent )
+                node->parent->lastChild = node;
+        }
+
+        slots = grow_array( slots, &capacity, count + 2, sizeof( Slot ) );
+        slots[count++] = ( Slot ){ node, false };
+        slots[count++] = ( Slot ){ node, true };
+    }
+
+    free( slots );
+    return root;
+}
+
+// --------------------------------------
+/***** Count the nodes of the structure *****/
+static long count_nodes( TreeNode *root ) {
+    TreeIter it;
+    long count = 0;
+
+    tree_iter_init( &it, root, true );
+    while ( tree_iter_next( &it ) != NULL )
+        count++;
+
+    return count;
+}
+
+// --------------------------------------
+/***** Checksum of the structure (FNV-1a) *****/
+static uint32_t tree_checksum( const char *buf, size_t len ) {
+    uint32_t hash = 2166136261u;
+
+    for ( size_t i = 0; i < len; i++ ) {
+        hash ^= (uint8_t)buf[i];
+        hash *= 16777619u;
     }
+    return hash;
+}
+
+// --------------------------------------
+/***** Read a text structure from memory *****/
+static TreeNode *read_text_tree( const char *text, size_t len ) {
+    FILE *mem = fmemopen( (void *)text, len, "rb" );
+    if ( mem == NULL )
+        error_tree( "memory allocation" );
+
+    TreeNode *root = read_tree( mem );
+    fclose( mem );
+
+    if ( root == NULL )
+        error_tree( "tree not found" );
+
+    return root;
+}
+
+// --------------------------------------
+/***** Convert a node to its binary form *****/
+static void encode_node( const BlockInfo *data, TreeRecord *rec ) {
+    memset( rec, 0, sizeof( TreeRecord ) );
+
+    rec->start = data->start;
+    rec->end = data->end == BLOCK_NO_RECORD ? -1 : (int64_t)data->end;
+    snprintf( rec->tag, sizeof( rec->tag ), "%s", block_tag( data ) );
+
+    memcpy( rec->hash, data->hash, TREE_HASH_SIZE );
+    rec->date = data->date;
+    rec->flags = data->flags & ( TREE_HAS_HASH | TREE_HAS_DATE );
+}
 
-    return NULL;
+// --------------------------------------
+/***** Convert a binary node to BlockInfo (the tag goes in the pool) *****/
+static void decode_node( const TreeRecord *rec, BlockInfo *data ) {
+    memset( data, 0, sizeof( BlockInfo ) );
+    set_offsets( data, rec->start, rec->end );
+    data->tag = intern_tag( rec->tag, strnlen( rec->tag, sizeof( rec->tag ) - 1 ) );
+
+    data->flags = rec->flags & ( TREE_HAS_HASH | TREE_HAS_DATE );
+    if ( data->flags & TREE_HAS_HASH )
+        memcpy( data->hash, rec->hash, TREE_HASH_SIZE );
+    if ( data->flags & TREE_HAS_DATE )
+        data->date = rec->date;
 }
 
 // --------------------------------------
-/***** Write structure at the end of the file *****/
-void save_to_file( TreeNode *root, const char *file_note ) {
-    FILE *fp;
-    if ( ( fp = fopen( file_note, "rb+" ) ) == NULL )
-        error_tree( "file opening failed" );
+/***** Store the structure in preorder, the position of each node becomes its slot *****/
+static void pack_tree( TreeNode *root, TreeRecord *records, long count ) {
+    int32_t *last = malloc( ( count ? count : 1 ) * sizeof( int32_t ) ); // Last node seen at each depth
+    if ( last == NULL )
+        error_tree( "memory allocation" );
+
+    TreeIter it;
+    TreeNode *node;
+    int32_t index = 0;
+
+    //! The first child follows its parent, a sibling is linked from the last node at its depth
+
+    tree_iter_init( &it, root, true );
+    while ( ( node = tree_iter_next( &it ) ) != NULL ) {
+        node->data.slot = index;
+        node->data.flags &= ~TREE_CHANGED;
+
+        encode_node( &node->data, &records[index] );
+        records[index].first_child = node->firstChild ? index + 1 : -1;
+        records[index].next_sibling = -1;
+
+        if ( node->prevSibling != NULL )
+            records[last[it.depth]].next_sibling = index;
 
-    fseek( fp, 0, SEEK_END );
-    fprintf( fp, "\n %s \n", DELIMITER );
-    write_tree( fp, root );
-    fclose( fp );
+        last[it.depth] = index++;
+    }
+
+    free( last );
+}
+
+// --------------------------------------
+/***** Store the changed nodes, their links hold slots *****/
+static void pack_changes( TreeNode *root, TreeChange *changes ) {
+    TreeIter it;
+    TreeNode *node;
+    long index = 0;
+
+    tree_iter_init( &it, root, true );
+    while ( ( node = tree_iter_next( &it ) ) != NULL ) {
+        if ( !( node->data.flags & TREE_CHANGED ) )
+            continue;
+
+        TreeChange *change = &changes[index++];
+
+        memset( change, 0, sizeof( TreeChange ) );
+        change->slot = node->data.slot;
+        encode_node( &node->data, &change->rec );
+        change->rec.first_child = node->firstChild ? (int32_t)node->firstChild->data.slot : -1;
+        change->rec.next_sibling = node->nextSibling ? (int32_t)node->nextSibling->data.slot : -1;
+
+        node->data.flags &= ~TREE_CHANGED;
+    }
 }
 
 // --------------------------------------
-/***** Find the delimiter that divides the structure from the data *****/
-static int find_delimiter( FILE *fp ) {
-    fseek( fp, 0, SEEK_END );
+/***** Serialize the changed nodes (or the whole structure) followed by the footer *****/
+char *save_to_memory( TreeNode *root, uint64_t offset, TreeLog *log, size_t *len ) {
+    TreeIter it;
+    TreeNode *node;
+    uint64_t count = 0, changed = 0, added = 0;
+
+    tree_iter_init( &it, root, true );
+    while ( ( node = tree_iter_next( &it ) ) != NULL ) {
+        count++;
+        changed += ( node->data.flags & TREE_CHANGED ) != 0;
+        added += node->data.slot == TREE_NO_SLOT;
+    }
+
+    //! A tree without nodes could not be loaded again
+
+    if ( root == NULL )
+        error_tree( "tree not found" );
+
+    if ( count > INT32_MAX )
+        error_tree( "too many nodes" );
+
+    size_t whole = count * sizeof( TreeRecord ) + sizeof( TreeFooter );
+    size_t delta = sizeof( TreeDelta ) + changed * sizeof( TreeChange ) + sizeof( TreeFooter );
 
-    long position = ftell( fp );
+    //! The changes are appended while the structures to read stay within twice the whole one,
+    //! and the slots left by the removed nodes within the count of the live ones
 
-    while ( position >= 0 ) {
-        fseek( fp, position, SEEK_SET );
-        char ch = fgetc( fp );
+    bool append = log->end != 0 && log->bytes + delta <= 2 * whole &&
+                  log->slots + added <= 2 * count && log->slots + added <= INT32_MAX;
 
-        if ( ch == ' ' || ch == '\n' ) {
-            char word[100];
-            fscanf( fp, "%s", word );
-            if ( strcmp( word, DELIMITER ) == 0 )
-                return position;
+    char *out = malloc( append ? delta : whole );
+    if ( out == NULL )
+        error_tree( "memory allocation" );
+
+    TreeFooter footer = { 0 };
+    memcpy( footer.magic, FOOTER_MAGIC, sizeof( footer.magic ) );
+    footer.tree_offset = offset;
+    footer.live = log->live;
+
+    if ( append ) {
+        TreeDelta head = { log->end, log->bytes + delta, 0, 0 };
+
+        //! New nodes take the next slots, the changed nodes may link to them
+
+        tree_iter_init( &it, root, true );
+        while ( ( node = tree_iter_next( &it ) ) != NULL ) {
+            if ( node->data.slot == TREE_NO_SLOT )
+                node->data.slot = log->slots++;
         }
-        position--;
+
+        head.slots = log->slots;
+        head.root = root->data.slot;
+        memcpy( out, &head, sizeof( head ) );
+        pack_changes( root, (TreeChange *)( out + sizeof( head ) ) );
+
+        footer.version = FOOTER_VERSION_DELTA;
+        footer.record_count = changed;
+        log->bytes = head.bytes;
+    } else {
+        pack_tree( root, (TreeRecord *)out, count );
+
+        footer.version = FOOTER_VERSION;
+        footer.record_count = count;
+        log->slots = count;
+        log->bytes = whole;
+    }
+
+    footer.tree_length = ( append ? delta : whole ) - sizeof( footer );
+    footer.checksum = tree_checksum( out, footer.tree_length );
+    memcpy( out + footer.tree_length, &footer, sizeof( footer ) );
+
+    *len = footer.tree_length + sizeof( footer );
+    log->end = offset + *len;
+    return out;
+}
+
+// --------------------------------------
+/***** Find the delimiter that divides the structure from the data (legacy files) *****/
+static long find_delimiter( const char *base, size_t size ) {
+    size_t len = strlen( DELIMITER );
+
+    for ( long position = (long)size - (long)len; position > 0; position-- ) {
+        if ( ( base[position - 1] == ' ' || base[position - 1] == '\n' ) &&
+             memcmp( base + position, DELIMITER, len ) == 0 )
+            return position + len;
     }
     error_tree( "tree not found" );
     return -1;
 }
 
 // --------------------------------------
-/***** Load data from file *****/
-TreeNode *load_from_file( TreeNode *root, BlockInfo *data, const char *file_note ) {
-    ;
-    FILE *fp;
-    if ( ( fp = fopen( file_note, "rb" ) ) == NULL )
-        error_tree( "file opening failed" );
+/***** Footer ending at "end", with the bounds of its structure (false if there is none) *****/
+static bool read_footer( tree_read_function read, void *ctx, uint64_t end, TreeFooter *footer ) {
+    memcpy( footer, read( ctx, end - sizeof( *footer ), end ), sizeof( *footer ) );
+    if ( memcmp( footer->magic, FOOTER_MAGIC, sizeof( footer->magic ) ) != 0 )
+        return false;
 
-    fseek( fp, 0, SEEK_END );
-    int check = ftell( fp );
+    if ( footer->version != FOOTER_VERSION && footer->version != FOOTER_VERSION_TEXT &&
+         footer->version != FOOTER_VERSION_DELTA )
+        error_tree( "tree version not supported" );
 
-    if ( check > 0 ) {
-        find_delimiter( fp );
-        root = read_tree( fp );
-        fclose( fp );
-    } else {
-        fclose( fp );
+    //! Each term is bounded on its own, so a huge length cannot wrap the sum around
 
-        strcpy( data->tag, INITIAL_TAG );
+    if ( footer->tree_length == 0 || footer->tree_offset > end - sizeof( *footer ) ||
+         footer->tree_length > end - sizeof( *footer ) - footer->tree_offset )
+        error_tree( "tree corrupted" );
+
+    return true;
+}
+
+// --------------------------------------
+/***** Structure pointed to by the footer *****/
+static const char *read_section( tree_read_function read, void *ctx, const TreeFooter *footer ) {
+    const char *tree = read( ctx, footer->tree_offset, footer->tree_offset + footer->tree_length );
+
+    if ( tree_checksum( tree, footer->tree_length ) != footer->checksum )
+        error_tree( "tree corrupted" );
+
+    return tree;
+}
+
+// --------------------------------------
+/***** Node of a loaded slot (each slot is linked only once) *****/
+static TreeNode *slot_node( const TreeRecord *records, uint8_t *loaded, uint32_t slots, int64_t slot ) {
+    if ( slot < 0 || slot >= slots || loaded[slot] != 1 )
+        error_tree( "tree corrupted" );
+
+    loaded[slot] = 2;
+
+    BlockInfo data;
+    decode_node( &records[slot], &data );
+
+    TreeNode *node = insert_node( NULL, &data );
+    node->data.slot = slot;
+    return node;
+}
+
+// --------------------------------------
+/***** Link the nodes reachable from the root slot, in preorder *****/
+static TreeNode *build_tree( const TreeRecord *records, uint8_t *loaded, uint32_t slots, uint32_t root ) {
+    TreeNode *top = slot_node( records, loaded, slots, root );
+    TreeNode *node = top;
+
+    //! Since a slot cannot be linked twice, the links cannot form cycles
+
+    while ( node != NULL ) {
+        if ( records[node->data.slot].first_child != -1 ) {
+            TreeNode *child = slot_node( records, loaded, slots, records[node->data.slot].first_child );
+            link_child( node, child );
+            node = child;
+            continue;
+        }
+
+        //! Without children, the walk goes on with the next sibling of the node or of its nearest ancestor
+
+        while ( node != NULL && records[node->data.slot].next_sibling == -1 )
+            node = node->parent;
+
+        if ( node == NULL )
+            break;
+
+        TreeNode *sibling = slot_node( records, loaded, slots, records[node->data.slot].next_sibling );
+
+        if ( node->parent != NULL )
+            link_child( node->parent, sibling );
+        else {
+            node->nextSibling = sibling;
+            sibling->prevSibling = node;
+        }
+        node = sibling;
+    }
+
+    //! The nodes are as saved, linking them does not change them
+
+    TreeIter it;
+
+    tree_iter_init( &it, top, true );
+    while ( ( node = tree_iter_next( &it ) ) != NULL )
+        node->data.flags &= ~TREE_CHANGED;
+
+    return top;
+}
+
+// --------------------------------------
+/***** Load data from memory *****/
+TreeNode *load_from_memory( TreeNode *root, BlockInfo *data, const char *base, size_t size ) {
+
+    if ( size > 0 ) { // Legacy files without footer
+        long position = find_delimiter( base, size );
+        root = read_text_tree( base + position, size - position );
+    } else {
+        block_set_tag( data, INITIAL_TAG );
 
         root = insert_node( root, data );
-        root->data.end = -1;
+        root->data.end = BLOCK_NO_RECORD;
     }
     return root;
 }
+
+// --------------------------------------
+/***** Load the structures ending at "size" *****/
+TreeNode *load_from_log( tree_read_function read, void *ctx, uint64_t size, TreeLog *log ) {
+    TreeFooter footer;
+
+    if ( size < sizeof( footer ) || !read_footer( read, ctx, size, &footer ) )
+        return NULL;
+
+    memset( log, 0, sizeof( TreeLog ) );
+    log->live = footer.live;
+    log->bytes = footer.tree_length + sizeof( footer );
+
+    //! A text structure is read as a whole, the next save writes a binary one
+
+    if ( footer.version == FOOTER_VERSION_TEXT )
+        return read_text_tree( read_section( read, ctx, &footer ), footer.tree_length );
+
+    TreeRecord *records = NULL;
+    uint8_t *loaded = NULL; // 1 = record loaded, 2 = node linked
+    uint32_t root = 0;
+
+    //! From the last structure back to the whole one, a slot already loaded hides its older records
+
+    while ( footer.version == FOOTER_VERSION_DELTA ) {
+        const char *tree = read_section( read, ctx, &footer );
+        TreeDelta head;
+        TreeChange change;
+
+        if ( footer.tree_length < sizeof( head ) ||
+             ( footer.tree_length - sizeof( head ) ) % sizeof( change ) != 0 ||
+             ( footer.tree_length - sizeof( head ) ) / sizeof( change ) != footer.record_count )
+            error_tree( "tree corrupted" );
+
+        memcpy( &head, tree, sizeof( head ) );
+
+        if ( records == NULL ) {
+            if ( head.slots == 0 || head.slots > INT32_MAX || head.bytes < log->bytes )
+                error_tree( "tree corrupted" );
+
+            log->slots = head.slots;
+            log->bytes = head.bytes;
+            root = head.root;
+            records = malloc( head.slots * sizeof( TreeRecord ) );
+            loaded = calloc( head.slots, 1 );
+            if ( records == NULL || loaded == NULL )
+                error_tree( "memory allocation" );
+        }
+
+        if ( head.slots > log->slots || head.previous < sizeof( footer ) || head.previous > footer.tree_offset )
+            error_tree( "tree corrupted" );
+
+        for ( uint64_t i = 0; i < footer.record_count; i++ ) {
+            memcpy( &change, tree + sizeof( head ) + i * sizeof( change ), sizeof( change ) );
+            if ( change.slot >= head.slots )
+                error_tree( "tree corrupted" );
+
+            if ( !loaded[change.slot] ) {
+                records[change.slot] = change.rec;
+                loaded[change.slot] = 1;
+            }
+        }
+
+        if ( !read_footer( read, ctx, head.previous, &footer ) || footer.version == FOOTER_VERSION_TEXT )
+            error_tree( "tree corrupted" );
+    }
+
+    //! The whole structure is stored in preorder, the position of each record is its slot
+
+    uint64_t count = footer.record_count;
+
+    if ( count == 0 || count > INT32_MAX || footer.tree_length != count * sizeof( TreeRecord ) ||
+         ( records != NULL && count > log->slots ) )
+        error_tree( "tree corrupted" );
+
+    if ( records == NULL ) {
+        log->slots = count;
+        records = malloc( count * sizeof( TreeRecord ) );
+        loaded = calloc( count, 1 );
+        if ( records == NULL || loaded == NULL )
+            error_tree( "memory allocation" );
+    }
+
+    const char *tree = read_section( read, ctx, &footer );
+
+    for ( uint64_t i = 0; i < count; i++ ) {
+        if ( !loaded[i] ) {
+            memcpy( &records[i], tree + i * sizeof( TreeRecord ), sizeof( TreeRecord ) );
+            loaded[i] = 1;
+        }
+    }
+
+    TreeNode *top = build_tree( records, loaded, log->slots, root );
+
+    log->end = size;
+    free( records );
+    free( loaded );
+    return top;
+}
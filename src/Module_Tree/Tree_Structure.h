@@ -21,33 +21,177 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "Prefix_Match.h"
 
 #define STRNODE "*NODE*"
 #define STRNODENULL "*NULL*"
 #define DELIMITER "*====*"
 #define INITIAL_TAG "/"
 
-typedef struct {
-    long start;
-    long end;
-    char hash[42];
-    char tag[24];
-    char date[20];
+#define FOOTER_MAGIC "NTMF"
+#define FOOTER_VERSION 2       // Binary structure
+#define FOOTER_VERSION_TEXT 1  // Text structure
+#define FOOTER_VERSION_DELTA 3 // Binary nodes changed since the previous structure
+
+#define TREE_HASH_SIZE 20
+#define TREE_HASH_TEXT 41 // Hexadecimal hash with its terminator
+#define TREE_TAG_SIZE 24  // Tag with its terminator
+#define TREE_DATE_TEXT 20 // Formatted date with its terminator
+#define TREE_DATE_FORMAT "%Y-%m-%d %H:%M:%S"
+#define TREE_HAS_HASH 0x01
+#define TREE_HAS_DATE 0x02
+#define TREE_CHANGED 0x80 // Changed since the structure was saved (never stored)
+#define TREE_NO_SLOT UINT32_MAX
+
+#define BLOCK_NO_RECORD UINT32_MAX // "end" of a node without record (the root)
+
+// Nodes of the first slab of the arena, every further slab doubles up to the limit
+#define ARENA_SLAB_MIN 64
+#define ARENA_SLAB_MAX 65536
+
+typedef struct { //! Data of a node (hash and date are formatted only to be shown)
+    int64_t date; // Seconds since 1970, no time zone (TREE_HAS_DATE)
+    uint32_t start;
+    uint32_t end; // 0 = record not written yet, BLOCK_NO_RECORD = no record
+    uint32_t tag;  // Offset in the pool of the tags
+    uint32_t slot; // Position in the saved structure (TREE_NO_SLOT = not saved yet)
+    uint8_t hash[TREE_HASH_SIZE];
+    uint8_t flags;
 } BlockInfo;
 
 typedef struct TreeNode {
     BlockInfo data;
     struct TreeNode *firstChild;
     struct TreeNode *nextSibling;
+    struct TreeNode *parent;      // NULL for the root and for detached nodes
+    struct TreeNode *prevSibling; // NULL for the first child
+    struct TreeNode *lastChild;
 } TreeNode;
 
+typedef struct { //! Node of the binary structure, stored in preorder
+    int64_t start;
+    int64_t end;
+    int64_t date; // Seconds since 1970 (no time zone)
+    int32_t first_child;
+    int32_t next_sibling;
+    uint8_t hash[TREE_HASH_SIZE];
+    char tag[TREE_TAG_SIZE];
+    uint8_t flags;
+    uint8_t reserved[3];
+} TreeRecord;
+
+typedef struct { //! Fixed-size trailer at the end of the file
+    char magic[4];
+    uint32_t version;
+    uint64_t tree_offset;
+    uint64_t tree_length;
+    uint64_t record_count;
+    uint32_t checksum;
+    uint32_t live; // Bytes of the notes referenced by the tree (0 = unknown)
+} TreeFooter;
+
+typedef struct { //! Header of the nodes changed since the previous structure (FOOTER_VERSION_DELTA)
+    uint64_t previous; // End of the footer of the previous structure
+    uint64_t bytes;    // Bytes of the structures needed to load the tree, this one included
+    uint32_t slots;    // Slots given to the nodes so far
+    uint32_t root;     // Slot of the first node
+} TreeDelta;
+
+typedef struct { //! Changed node, its links hold slots
+    uint32_t slot;
+    uint32_t reserved;
+    TreeRecord rec;
+} TreeChange;
+
+typedef struct { //! Structures saved at the end of the notes
+    uint64_t end;   // End of the footer of the last structure (0 = save the whole structure)
+    uint64_t bytes; // Bytes of the structures needed to load the tree
+    uint32_t slots;
+    uint32_t live; // Bytes of the notes referenced by the tree (0 = unknown)
+} TreeLog;
+
+typedef struct { //! Preorder walk without recursion, following the parent links
+    TreeNode *next;
+    int next_depth;
+    int depth;     // Depth of the last node returned (0 = the first node and its siblings)
+    bool siblings; // Also walk the siblings that follow the first node
+} TreeIter;
+
+typedef struct { //! Nodes sorted by hash (build it again after the tree changes)
+    TreeNode **nodes;
+    size_t count;
+} HashIndex;
+
+typedef enum { //! Result of a search by hash prefix
+    HASH_NOT_FOUND,
+    HASH_UNIQUE,
+    HASH_AMBIGUOUS
+} HashLookup;
+
+typedef struct { //! Entry of the tag index
+    TreeNode *node;
+    long order; // Position of the node in preorder
+} TagEntry;
+
+typedef struct { //! Nodes sorted by tag without case (build it again after the tree changes)
+    TagEntry *entries;
+    size_t count;
+} TagIndex;
+
+typedef struct { //! Metadata of the tree in preorder, one array per field
+    TreeNode **nodes;
+    int32_t *depth;
+    char ( *tags )[TREE_TAG_SIZE];       // Folded to lower case
+    uint8_t ( *hashes )[TREE_HASH_SIZE]; // Raw bytes (TREE_HAS_HASH)
+    int64_t *dates;                      // Seconds since 1970, no time zone (TREE_HAS_DATE)
+    uint32_t *start;
+    uint32_t *end;
+    uint8_t *flags;
+    size_t count;
+} TreeColumns;
+
 typedef int ( *find_function )( TreeNode *, char * );
 
-// Free memory
+// Pointer to the bytes [start, end) of the notes (valid until the next call)
+typedef const char *( *tree_read_function )( void *ctx, uint64_t start, uint64_t end );
+
+// Tag of a node (valid until the next tag is added to the pool)
+const char *block_tag( const BlockInfo *data );
+
+// Set the tag, stored once in the pool (cut to TREE_TAG_SIZE - 1 characters)
+void block_set_tag( BlockInfo *data, const char *tag );
+
+// Hash in hexadecimal ("." if the node has none)
+char *block_hash( const BlockInfo *data, char text[TREE_HASH_TEXT] );
+
+// Set the hash from hexadecimal digits
+void block_set_hash( BlockInfo *data, const char *text );
+
+// Date as TREE_DATE_FORMAT ("." if the node has none)
+char *block_date( const BlockInfo *data, char text[TREE_DATE_TEXT] );
+
+// Set the date from TREE_DATE_FORMAT
+void block_set_date( BlockInfo *data, const char *text );
+
+// Set the offsets of the record
+void block_set_record( BlockInfo *data, uint32_t start, uint32_t end );
+
+// Walk "root" with its descendants (and the siblings that follow it if "siblings" is set)
+void tree_iter_init( TreeIter *it, TreeNode *root, bool siblings );
+
+// Next node in preorder (NULL at the end)
+TreeNode *tree_iter_next( TreeIter *it );
+
+// Free memory (the nodes go back to the arena)
 void free_tree( TreeNode *root );
 
-// Auxiliary function to check for duplicate tags in the tree
-void check_duplicate( TreeNode *root, char *key, find_function find, int *cont );
+// Release every node and tag at once
+void free_tree_arena( void );
 
 // Auxiliary function to check if a node is a descendant of another node
 int is_descendant( TreeNode *potentialDescendant, TreeNode *ancestor );
@@ -61,28 +205,52 @@ int find_hash_node( TreeNode *node, char *hash );
 // Search date
 int find_date_node( TreeNode *node, char *date );
 
-// Search node
-TreeNode *find_node( TreeNode *root, char *key, find_function find );
+// Sort the nodes of the tree by hash
+void hash_index_build( HashIndex *index, TreeNode *root );
+
+// Free the index
+void hash_index_free( HashIndex *index );
 
-// Search previous sibling
-TreeNode *find_previous_sibling( TreeNode *root, TreeNode *node );
+// Search the nodes whose hash starts with "prefix" ("found" is the first one)
+HashLookup hash_index_find( const HashIndex *index, const char *prefix, TreeNode **found );
+
+// Shortest prefix that identifies the hash of "node"
+int hash_index_prefix( const HashIndex *index, const TreeNode *node );
+
+// Sort the nodes of the tree by tag
+void tag_index_build( TagIndex *index, TreeNode *root );
+
+// Free the index
+void tag_index_free( TagIndex *index );
+
+// Count the nodes whose tag starts with "prefix" ("found" is the first one in preorder)
+size_t tag_index_find( const TagIndex *index, const char *prefix, TreeNode **found );
+
+// Lay out the metadata of the tree in preorder
+void tree_columns_build( TreeColumns *cols, TreeNode *root );
+
+// Free the columns
+void tree_columns_free( TreeColumns *cols );
+
+// Position of the next node from "from" on that satisfies "find" (-1 if none)
+long tree_columns_find( const TreeColumns *cols, char *key, find_function find, long from );
 
 // Insert new node
 TreeNode *insert_node( TreeNode *currentNode, const BlockInfo *data );
 
 // Remove node and its descendants
-TreeNode *remove_node( TreeNode *root, char *hash );
-
-// Copy sub tree
-TreeNode *copy_subtree( TreeNode *subtree );
+TreeNode *remove_node( TreeNode *root, TreeNode *node );
 
 // Move node
-TreeNode *move_node( TreeNode *root, char *keyDestination, char *keySource, find_function find );
+TreeNode *move_node( TreeNode *root, char *keyDestination, TreeNode *sourceNode, const HashIndex *index );
+
+// Serialize the nodes changed since the last structure (or the whole structure) and the footer, appended at "offset"
+char *save_to_memory( TreeNode *root, uint64_t offset, TreeLog *log, size_t *len );
 
-// Write structure at the end of the file
-void save_to_file( TreeNode *root, const char *file_note );
+// Load data from memory (legacy files without footer, or a new tree if "size" is 0)
+TreeNode *load_from_memory( TreeNode *root, BlockInfo *data, const char *base, size_t size );
 
-//  Load data from file
-TreeNode *load_from_file( TreeNode *root, BlockInfo *data, const char *file_note );
+// Load the structures ending at "size" (NULL if the notes do not end with a footer)
+TreeNode *load_from_log( tree_read_function read, void *ctx, uint64_t size, TreeLog *log );
 
 #endif // TREE_STRUCTURE_H
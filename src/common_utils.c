@@ -52,11 +52,8 @@ void init_setting( char *set_file, char *pass, AppGlobal *app ) {
 // --------------------------------------
 /***** Initialize structure BlockInfo *****/
 void init_blockinfo( BlockInfo *data ) {
-    data->start = 0;
-    data->end = 0;
-    strcpy( data->hash, "." );
-    strcpy( data->tag, "." );
-    strcpy( data->date, "." );
+    memset( data, 0, sizeof( BlockInfo ) );
+    block_set_tag( data, "." );
 }
 
 // --------------------------------------
@@ -200,10 +197,8 @@ void generate_sha1( const NotesData *data, AppGlobal *app ) {
     memcpy( buffer, data, sizeof( NotesData ) );
 
     SHA1( buffer, sizeof( NotesData ), hash );
-    for ( size_t i = 0; i < SHA_DIGEST_LENGTH; i++ ) {
-        sprintf( app->data.hash + i * 2, "%02x", hash[i] );
-    }
-    app->data.hash[SHA_DIGEST_LENGTH * 2] = '\0';
+    memcpy( app->data.hash, hash, TREE_HASH_SIZE );
+    app->data.flags |= TREE_HAS_HASH;
 }
 
 // --------------------------------------
@@ -231,3 +226,48 @@ void copy_ndat( NotesData *dest, NotesData *src ) {
     } else
         dest->Body = NULL;
 }
+
+// --------------------------------------
+/***** Index of the hashes, sorted the first time it is needed *****/
+const HashIndex *note_hashes( AppGlobal *app ) {
+    if ( app->hashes.nodes == NULL )
+        hash_index_build( &app->hashes, app->root );
+    return &app->hashes;
+}
+
+// --------------------------------------
+/***** Node identified by a hash prefix (NULL if not found) *****/
+TreeNode *find_hash( AppGlobal *app, const char *hash ) {
+    TreeNode *node;
+
+    if ( hash_index_find( note_hashes( app ), hash, &node ) == HASH_AMBIGUOUS ) {
+        fprintf( stderr, "[ERROR] duplicate hash \n" );
+        exit( EXIT_FAILURE );
+    }
+
+    return node;
+}
+
+// --------------------------------------
+/***** Index of the tags, sorted the first time it is needed *****/
+const TagIndex *note_tags( AppGlobal *app ) {
+    if ( app->tags.entries == NULL )
+        tag_index_build( &app->tags, app->root );
+    return &app->tags;
+}
+
+// --------------------------------------
+/***** Metadata of the tree in columns, laid out the first time it is needed *****/
+const TreeColumns *note_columns( AppGlobal *app ) {
+    if ( app->cols.nodes == NULL )
+        tree_columns_build( &app->cols, app->root );
+    return &app->cols;
+}
+
+// --------------------------------------
+/***** Release the indexes and the columns, built again on the next search *****/
+void note_indexes_free( AppGlobal *app ) {
+    hash_index_free( &app->hashes );
+    tag_index_free( &app->tags );
+    tree_columns_free( &app->cols );
+}
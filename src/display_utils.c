@@ -26,13 +26,16 @@
 #define MAX_DEPTH 1000
 static int __last_flags[MAX_DEPTH] = {0};
 
+// Deeper levels share the last flag
+#define LAST_FLAG(lvl) __last_flags[(lvl) < MAX_DEPTH ? (lvl) : MAX_DEPTH - 1]
+
 // --------------------------------------
 /***** Print the graphics for the tree nodes *****/
 #define BRANCH(depth, node, app)                                               \
   do {                                                                         \
     printf("%s%s", (app)->stl.color_generic, CSI "0m");                        \
     for (int lvl = 0; lvl < (depth) - 1; lvl++) {                              \
-      if (__last_flags[lvl])                                                   \
+      if (LAST_FLAG(lvl))                                                      \
         printf("    ");                                                        \
       else                                                                     \
         printf("│   ");                                                        \
@@ -40,20 +43,20 @@ static int __last_flags[MAX_DEPTH] = {0};
     if ((depth) > 0) {                                                         \
       int is_last = ((node)->nextSibling == NULL);                             \
       printf(is_last ? "└── " : "├── ");                                       \
-      __last_flags[(depth) - 1] = is_last;                                     \
+      LAST_FLAG((depth) - 1) = is_last;                                        \
     }                                                                          \
   } while (0)
 
 #define BRANCH_SPACE(depth, app)                                               \
   printf("%s%s", (app)->stl.color_generic, CSI "0m");                          \
   for (int lvl = 0; lvl < (depth) - 1; lvl++) {                                \
-    if (__last_flags[lvl])                                                     \
+    if (LAST_FLAG(lvl))                                                        \
       printf("    ");                                                          \
     else                                                                       \
       printf("│   ");                                                          \
   }                                                                            \
   if ((depth) > 0) {                                                           \
-    if (__last_flags[(depth) - 1])                                             \
+    if (LAST_FLAG((depth) - 1))                                                \
       printf("    ");                                                          \
     else                                                                       \
       printf("│   ");                                                          \
@@ -67,42 +70,40 @@ static int __last_flags[MAX_DEPTH] = {0};
 
 // --------------------------------------
 /***** Print body *****/
-static void print_body(char *str, int depth, AppGlobal *app) {
-  if (!str || !*str)
-    return;
+static void print_body(const FieldView *body, int depth, AppGlobal *app) {
+  const char *line = body->ptr;
+  const char *end = body->ptr + body->len;
 
-  char *buf = strdup(str);
-  if (!buf)
+  while (end > line && end[-1] == '\n')
+    end--;
+  if (line == end)
     return;
-  size_t len = strlen(buf);
-  while (len > 0 && buf[len - 1] == '\n') {
-    buf[--len] = '\0';
-  }
 
-  char *line = buf;
-  char *newline;
-  while ((newline = strchr(line, '\n')) != NULL) {
-    *newline = '\0';
+  const char *newline;
+  while ((newline = memchr(line, '\n', end - line)) != NULL) {
     CONNECTED_BRANCH(depth, app);
-    printf("%s%s%s\n", app->stl.color_body, line, CSI "0m");
+    printf("%s%.*s%s\n", app->stl.color_body, (int)(newline - line), line,
+           CSI "0m");
     BRANCH_SPACE(depth, app);
     line = newline + 1;
   }
-  if (*line) {
+  if (line < end) {
     CONNECTED_BRANCH(depth, app);
-    printf("%s%s%s\n", app->stl.color_body, line, CSI "0m");
+    printf("%s%.*s%s\n", app->stl.color_body, (int)(end - line), line,
+           CSI "0m");
   }
-  free(buf);
 }
 
 // --------------------------------------
 /***** Print file *****/
 void print_file(AppGlobal *app) {
-  NotesData *nd = &app->NDat;
+  char link_file[sizeof(app->NDat.Link_File)];
+  snprintf(link_file, sizeof(link_file), "%.*s",
+           (int)app->NView.Link_File.len, app->NView.Link_File.ptr);
   if (app->opts.with_flag_IO || (strcasecmp(app->cfg.editor, "Nul") == 0)) {
-    FILE *fp = fopen(nd->Link_File, "rb");
+    FILE *fp = fopen(link_file, "rb");
     if (!fp) {
-      fprintf(stderr, "[ERROR] file \"%s\" opening failed\n", nd->Link_File);
+      fprintf(stderr, "[ERROR] file \"%s\" opening failed\n", link_file);
       exit(EXIT_FAILURE);
     }
     int ch;
@@ -112,9 +113,9 @@ void print_file(AppGlobal *app) {
     printf("\n");
     fclose(fp);
   } else if (strcasecmp(app->cfg.editor, "Vim") == 0) {
-    execl("/bin/vim", "vim", nd->Link_File, NULL);
+    execl("/bin/vim", "vim", link_file, NULL);
   } else if (strcasecmp(app->cfg.editor, "Nano") == 0) {
-    execl("/bin/nano", "nano", nd->Link_File, NULL);
+    execl("/bin/nano", "nano", link_file, NULL);
   } else {
     fprintf(stderr, "[ERROR] illegal Editor\n");
     exit(EXIT_FAILURE);
@@ -124,65 +125,76 @@ void print_file(AppGlobal *app) {
 // --------------------------------------
 /***** Print data from a node *****/
 void print_node(AppGlobal *app, TreeNode *node, int depth) {
-  NotesData *nd = &app->NDat;
+  NotesView *nv = &app->NView;
+  char hash[TREE_HASH_TEXT], date[TREE_DATE_TEXT];
   if (app->opts.with_file_flag) {
     print_file(app);
     return;
   }
   if (!app->opts.with_body) {
     BRANCH(depth, node, app);
-    printf("%s%s %s%s%s ", app->stl.color_tag, node->data.tag,
-           app->stl.color_comment, nd->Comment, CSI "0m");
+    printf("%s%s %s%.*s%s ", app->stl.color_tag, block_tag(&node->data),
+           app->stl.color_comment, (int)nv->Comment.len, nv->Comment.ptr,
+           CSI "0m");
     if (!app->opts.with_extended) {
-      if (strlen(nd->Link_File))
+      if (nv->Link_File.len)
         printf("%s#%s ", app->stl.color_file, CSI "0m");
-      if (nd->Body && strlen(nd->Body))
+      if (nv->Body.len)
         printf("%s#%s ", app->stl.color_body, CSI "0m");
-      if (strlen(nd->Keywords))
+      if (nv->Keywords.len)
         printf("%s#%s ", app->stl.color_keywords, CSI "0m");
       printf("\n");
     } else {
-      if (strlen(nd->Link_File))
-        printf("%s%s%s ", app->stl.color_file, nd->Link_File, CSI "0m");
-      if (nd->Body && strlen(nd->Body))
+      if (nv->Link_File.len)
+        printf("%s%.*s%s ", app->stl.color_file, (int)nv->Link_File.len,
+               nv->Link_File.ptr, CSI "0m");
+      if (nv->Body.len)
         printf("%s#%s ", app->stl.color_body, CSI "0m");
-      if (strlen(nd->Keywords))
+      if (nv->Keywords.len)
         printf("%s#%s ", app->stl.color_keywords, CSI "0m");
-      printf("%s%s %s%s%s\n", app->stl.color_hash, node->data.hash,
-             app->stl.color_date, node->data.date, CSI "0m");
+      printf("%s%s %s%s%s\n", app->stl.color_hash,
+             block_hash(&node->data, hash), app->stl.color_date,
+             block_date(&node->data, date), CSI "0m");
     }
   } else {
     BRANCH(depth, node, app);
-    printf("%s[%s]%s\n", app->stl.color_tag, node->data.tag, CSI "0m");
-    if (strlen(nd->Comment)) {
+    printf("%s[%s]%s\n", app->stl.color_tag, block_tag(&node->data),
+           CSI "0m");
+    if (nv->Comment.len) {
       BRANCH_SPACE(depth, app);
       CONNECTED_BRANCH(depth, app);
-      printf("%s%s%s\n", app->stl.color_comment, nd->Comment, CSI "0m");
+      printf("%s%.*s%s\n", app->stl.color_comment, (int)nv->Comment.len,
+             nv->Comment.ptr, CSI "0m");
     }
-    if (nd->Body && strlen(nd->Body)) {
+    if (nv->Body.len) {
+      read_body(nv, app);
       BRANCH_SPACE(depth, app);
-      print_body(nd->Body, depth, app);
+      print_body(&nv->Body, depth, app);
     }
-    if (strlen(nd->Link_File)) {
+    if (nv->Link_File.len) {
       BRANCH_SPACE(depth, app);
       CONNECTED_BRANCH(depth, app);
-      printf("%s%s%s\n", app->stl.color_file, nd->Link_File, CSI "0m");
+      printf("%s%.*s%s\n", app->stl.color_file, (int)nv->Link_File.len,
+             nv->Link_File.ptr, CSI "0m");
     }
     if (app->opts.with_extended) {
-      if (strlen(nd->Keywords) > 1) {
+      if (nv->Keywords.len > 1) {
         BRANCH_SPACE(depth, app);
         CONNECTED_BRANCH(depth, app);
-        printf("%s%s%s\n", app->stl.color_keywords, nd->Keywords, CSI "0m");
+        printf("%s%.*s%s\n", app->stl.color_keywords, (int)nv->Keywords.len,
+               nv->Keywords.ptr, CSI "0m");
       }
-      if (strlen(node->data.hash) > 1) {
+      if (node->data.flags & TREE_HAS_HASH) {
         BRANCH_SPACE(depth, app);
         CONNECTED_BRANCH(depth, app);
-        printf("%s%s%s\n", app->stl.color_hash, node->data.hash, CSI "0m");
+        printf("%s%s%s\n", app->stl.color_hash, block_hash(&node->data, hash),
+               CSI "0m");
       }
-      if (strlen(node->data.date) > 1) {
+      if (node->data.flags & TREE_HAS_DATE) {
         BRANCH_SPACE(depth, app);
         CONNECTED_BRANCH(depth, app);
-        printf("%s%s%s\n", app->stl.color_date, node->data.date, CSI "0m");
+        printf("%s%s%s\n", app->stl.color_date, block_date(&node->data, date),
+               CSI "0m");
       }
     }
     BRANCH_SPACE(depth, app);
@@ -192,60 +204,59 @@ void print_node(AppGlobal *app, TreeNode *node, int depth) {
   }
 }
 
+// --------------------------------------
+/***** Decrypt or mask a protected note before printing *****/
+static void unlock_dat(AppGlobal *app, char *Passwd, char *Key) {
+  static NotesData plain = {0};
+  if (!app->NView.Protection)
+    return;
+  read_body(&app->NView, app);
+  view_to_ndat(&app->NView, &plain);
+  init_ctx_from_ndat(&app->ctx, &plain);
+  if (app->opts.with_protection)
+    protect_decrypt(Passwd, &app->ctx, Key);
+  else
+    mask(&app->ctx);
+  ndat_to_view(&plain, &app->NView);
+}
+
 // --------------------------------------
 /***** Print data from all nodes *****/
 void print_all(TreeNode *root, int depth, AppGlobal *app, char *Passwd,
                char *Key) {
-  if (!root)
-    return;
-  read_dat(root->data.start, root->data.end, app);
-  if (app->NDat.Protection) {
-    init_ctx_from_ndat(&app->ctx, &app->NDat);
-    if (app->opts.with_protection)
-      protect_decrypt(Passwd, &app->ctx, Key);
-    else
-      mask(&app->ctx);
+  TreeIter it;
+  TreeNode *node;
+
+  tree_iter_init(&it, root, true);
+  while ((node = tree_iter_next(&it)) != NULL) {
+    read_dat(node->data.start, node->data.end, app);
+    unlock_dat(app, Passwd, Key);
+    print_node(app, node, depth + it.depth);
   }
-  print_node(app, root, depth);
-  print_all(root->firstChild, depth + 1, app, Passwd, Key);
-  print_all(root->nextSibling, depth, app, Passwd, Key);
 }
 
 void print_list(TreeNode *root, int depth, AppGlobal *app, char *Passwd,
                 char *Key) {
-  if (!root)
-    return;
-  read_dat(root->data.start, root->data.end, app);
-  if (app->NDat.Protection) {
-    init_ctx_from_ndat(&app->ctx, &app->NDat);
-    if (app->opts.with_protection)
-      protect_decrypt(Passwd, &app->ctx, Key);
-    else
-      mask(&app->ctx);
+  for (TreeNode *node = root; node != NULL; node = node->nextSibling) {
+    read_dat(node->data.start, node->data.end, app);
+    unlock_dat(app, Passwd, Key);
+    print_node(app, node, depth);
   }
-  print_node(app, root, depth);
-  print_list(root->nextSibling, depth, app, Passwd, Key);
 }
 
 // --------------------------------------
 /***** Print the nodes found by the search (all data) *****/
-void print_find(TreeNode *root, char *key, find_function fn, AppGlobal *app,
-                char *Passwd, char *Key) {
-  if (!root)
-    return;
-  if (fn(root, key) == 0) {
-    read_dat(root->data.start, root->data.end, app);
-    if (app->NDat.Protection) {
-      init_ctx_from_ndat(&app->ctx, &app->NDat);
-      if (app->opts.with_protection)
-        protect_decrypt(Passwd, &app->ctx, Key);
-      else
-        mask(&app->ctx);
-    }
-    print_node(app, root, 0);
+void print_find(char *key, find_function fn, AppGlobal *app, char *Passwd,
+                char *Key) {
+  const TreeColumns *cols = note_columns(app);
+
+  for (long pos = tree_columns_find(cols, key, fn, 0); pos >= 0;
+       pos = tree_columns_find(cols, key, fn, pos + 1)) {
+    TreeNode *node = cols->nodes[pos];
+    read_dat(cols->start[pos], cols->end[pos], app);
+    unlock_dat(app, Passwd, Key);
+    print_node(app, node, 0);
   }
-  print_find(root->firstChild, key, fn, app, Passwd, Key);
-  print_find(root->nextSibling, key, fn, app, Passwd, Key);
 }
 
 // --------------------------------------
@@ -254,13 +265,7 @@ void print_children(TreeNode *parent, AppGlobal *app, char *Passwd, char *Key) {
   if (!parent || !parent->firstChild)
     return;
   read_dat(parent->data.start, parent->data.end, app);
-  if (app->NDat.Protection) {
-    init_ctx_from_ndat(&app->ctx, &app->NDat);
-    if (app->opts.with_protection)
-      protect_decrypt(Passwd, &app->ctx, Key);
-    else
-      mask(&app->ctx);
-  }
+  unlock_dat(app, Passwd, Key);
   print_node(app, parent, 1);
   print_all(parent->firstChild, 2, app, Passwd, Key);
 }
@@ -271,82 +276,76 @@ void print_sibling(TreeNode *parent, AppGlobal *app, char *Passwd, char *Key) {
   if (!parent || !parent->firstChild)
     return;
   read_dat(parent->data.start, parent->data.end, app);
-  if (app->NDat.Protection) {
-    init_ctx_from_ndat(&app->ctx, &app->NDat);
-    if (app->opts.with_protection)
-      protect_decrypt(Passwd, &app->ctx, Key);
-    else
-      mask(&app->ctx);
-  }
+  unlock_dat(app, Passwd, Key);
   print_node(app, parent, 1);
   print_list(parent->firstChild, 2, app, Passwd, Key);
 }
 
 // --------------------------------------
-/***** Print the nodes found by the search (structure only) *****/
-void print_find_node(TreeNode *root, char *key, find_function fn,
-                     AppGlobal *app) {
-  if (!root)
-    return;
-
-  if (fn(root, key) == 0) {
-    read_dat(root->data.start, root->data.end, app);
-    printf("%s%s %s%s %s%s%s\n", app->stl.color_tag, root->data.tag,
-           app->stl.color_hash, root->data.hash, app->stl.color_file,
-           strlen(app->NDat.Link_File) ? "#" : "", CSI "0m");
+/***** Print the nodes found (structure only, shortest hashes) *****/
+void print_find_node(char *key, find_function fn, AppGlobal *app) {
+  const TreeColumns *cols = note_columns(app);
+
+  for (long pos = tree_columns_find(cols, key, fn, 0); pos >= 0;
+       pos = tree_columns_find(cols, key, fn, pos + 1)) {
+    TreeNode *node = cols->nodes[pos];
+    char hash[TREE_HASH_TEXT];
+    read_dat(cols->start[pos], cols->end[pos], app);
+    printf("%s%s %s%.*s %s%s%s\n", app->stl.color_tag, block_tag(&node->data),
+           app->stl.color_hash, hash_index_prefix(note_hashes(app), node),
+           block_hash(&node->data, hash), app->stl.color_file,
+           app->NView.Link_File.len ? "#" : "", CSI "0m");
   }
-  print_find_node(root->firstChild, key, fn, app);
-  print_find_node(root->nextSibling, key, fn, app);
 }
 
 // --------------------------------------
 /***** Print structure without data *****/
 void print_tree(TreeNode *root, int depth, AppGlobal *app) {
-  if (!root)
-    return;
-  BRANCH(depth, root, app);
-  printf("%s%s %s%s%s \n", app->stl.color_tag, root->data.tag,
-         app->stl.color_hash, app->opts.with_extended ? root->data.hash : "",
-         CSI "0m");
-  print_tree(root->firstChild, depth + 1, app);
-  print_tree(root->nextSibling, depth, app);
+  TreeIter it;
+  TreeNode *node;
+  char hash[TREE_HASH_TEXT];
+
+  tree_iter_init(&it, root, true);
+  while ((node = tree_iter_next(&it)) != NULL) {
+    BRANCH(depth + it.depth, node, app);
+    printf("%s%s %s%s%s \n", app->stl.color_tag, block_tag(&node->data),
+           app->stl.color_hash,
+           app->opts.with_extended ? block_hash(&node->data, hash) : "",
+           CSI "0m");
+  }
 }
 
 // --------------------------------------
 /***** Search nodes by date and print them *****/
-static void print_find_date(TreeNode *root, search_function searchFunc,
+static void print_find_date(const TreeColumns *cols, search_function searchFunc,
                             long *start, long *end, AppGlobal *app) {
-  if (!root)
-    return;
-
-  Date_Time dt = string_to_date(root->data.date);
-  long timestamp = date_to_seconds(dt);
-  if (searchFunc(timestamp, *end, *start)) {
-    read_dat(root->data.start, root->data.end, app);
-    print_node(app, root, 0);
+  // The root comes first and is skipped
+  for (size_t pos = 1; pos < cols->count; pos++) {
+    char date[TREE_DATE_TEXT];
+    long timestamp = cols->dates[pos];
+    if (!(cols->flags[pos] & TREE_HAS_DATE))
+      timestamp = date_to_seconds(
+          string_to_date(block_date(&cols->nodes[pos]->data, date)));
+
+    if (searchFunc(timestamp, *end, *start)) {
+      read_dat(cols->start[pos], cols->end[pos], app);
+      print_node(app, cols->nodes[pos], 0);
+    }
   }
-
-  if (root->firstChild)
-    print_find_date(root->firstChild, searchFunc, start, end, app);
-  if (root->nextSibling)
-    print_find_date(root->nextSibling, searchFunc, start, end, app);
 }
 
 // --------------------------------------
 /***** Start search by date *****/
-void process_data(TreeNode *root, AppGlobal *app) {
+void process_data(AppGlobal *app) {
 
   long start, end;
   search_function searchFunc =
       parse_search_date(app->opts.arg_date, &start, &end);
 
-  if (!root)
+  if (!app->root)
     return;
 
-  if (root->firstChild)
-    print_find_date(root->firstChild, searchFunc, &start, &end, app);
-  if (root->nextSibling)
-    print_find_date(root->nextSibling, searchFunc, &start, &end, app);
+  print_find_date(note_columns(app), searchFunc, &start, &end, app);
 }
 
 // --------------------------------------
@@ -363,8 +362,8 @@ static int tokenize(char *input, char tokens[MAX_WORDS][MAX_WORD_LEN]) {
 
 // --------------------------------------
 /***** Check that all keywords are found *****/
-static bool match_all_keywords(const char *keywords, const char *search) {
-  if (!keywords)
+static bool match_all_keywords(const FieldView *keywords, const char *search) {
+  if (!keywords->len)
     return false;
 
   char key_tokens[MAX_WORDS][MAX_WORD_LEN];
@@ -373,7 +372,8 @@ static bool match_all_keywords(const char *keywords, const char *search) {
   char kw_copy[MAX_KEYWORDS];
   char search_copy[MAX_KEYWORDS];
 
-  strncpy(kw_copy, keywords, MAX_KEYWORDS - 1);
+  snprintf(kw_copy, sizeof(kw_copy), "%.*s", (int)keywords->len,
+           keywords->ptr);
   strncpy(search_copy, search, MAX_KEYWORDS - 1);
 
   int key_count = tokenize(kw_copy, key_tokens);
@@ -397,18 +397,15 @@ static bool match_all_keywords(const char *keywords, const char *search) {
 // --------------------------------------
 /***** Search for nodes by keywords and print them *****/
 void print_find_keywords(TreeNode *root, const char *search, AppGlobal *app) {
-
-  if (!root)
-    return;
-
-  read_dat(root->data.start, root->data.end, app);
-  if (match_all_keywords(app->NDat.Keywords, search))
-    print_node(app, root, 0);
-
-  if (root->firstChild)
-    print_find_keywords(root->firstChild, search, app);
-  if (root->nextSibling)
-    print_find_keywords(root->nextSibling, search, app);
+  TreeIter it;
+  TreeNode *node;
+
+  tree_iter_init(&it, root, true);
+  while ((node = tree_iter_next(&it)) != NULL) {
+    read_dat(node->data.start, node->data.end, app);
+    if (match_all_keywords(&app->NView.Keywords, search))
+      print_node(app, node, 0);
+  }
 }
 
 // --------------------------------------
@@ -435,6 +432,7 @@ void help(void) {
          "   setting    Change the note file in use. \n"
          "   editor     Change editor used. \n"
          "   backup     Run backup. \n"
+         "   compact    Reclaim the space of old notes. \n"
          "   help       Complete guide. \n\n");
 
   printf("COMMON OPTIONS :\n"
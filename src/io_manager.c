@@ -19,301 +19,724 @@
  */
 
 // --------------------------------------
-/***** Calculates the hash of the current notes file *****/
-bool sha1_file( const char *filename, char out_hex[41] ) {
-    FILE *fp = fopen( filename, "rb" );
-    if ( !fp )
-        return false;
-    fseek( fp, 0, SEEK_END );
-    long sz = ftell( fp );
-    rewind( fp );
+/***** Grows the buffer to hold at least "len" more bytes *****/
+static void reserve_note( NotesBuffer *note, size_t len ) {
+    size_t used = note->size - note->kept;
 
-    unsigned char *buf = malloc( sz );
-    if ( !buf ) {
-        fclose( fp );
-        return false;
+    if ( used + len <= note->capacity )
+        return;
+
+    size_t capacity = note->capacity ? note->capacity : 4096;
+    while ( capacity < used + len )
+        capacity *= 2;
+
+    char *base = realloc( note->base, capacity );
+    if ( !base ) {
+        fprintf( stderr, "[ERROR] memory allocation\n" );
+        exit( EXIT_FAILURE );
     }
-    fread( buf, 1, sz, fp );
-    fclose( fp );
+    note->base = base;
+    note->capacity = capacity;
+}
 
-    unsigned char hash[SHA_DIGEST_LENGTH];
-    SHA1( buf, sz, hash );
-    free( buf );
+// --------------------------------------
+/***** Appends bytes at the end of the buffer *****/
+static void write_note( NotesBuffer *note, const void *ptr, size_t len ) {
+    if ( len == 0 )
+        return;
 
-    for ( int i = 0; i < SHA_DIGEST_LENGTH; i++ )
-        sprintf( out_hex + i * 2, "%02x", hash[i] );
-    out_hex[SHA_DIGEST_LENGTH * 2] = '\0';
-    return true;
+    reserve_note( note, len );
+    memcpy( note->base + ( note->size - note->kept ), ptr, len );
+    note->size += len;
+    note->dirty = true;
 }
 
 // --------------------------------------
-/***** Returns the next field delimited by FIELD_DELIM *****/
-static char *next_field( char **pptr ) {
-    if ( *pptr == NULL )
-        return NULL;
+/***** Decompress every block of the container in front of the notes already in the buffer *****/
+static void load_blocks( AppGlobal *app ) {
+    NotesBuffer *note = &app->note;
+    size_t capacity = note->size > note->blocks.header.raw_size ? note->size : note->blocks.header.raw_size;
 
-    char *start = *pptr;
-    char *pos = strstr( start, FIELD_DELIM );
-    if ( pos ) {
-        *pos = '\0';
-        *pptr = pos + strlen( FIELD_DELIM );
+    char *base = malloc( capacity ? capacity : 1 );
+    if ( !base ) {
+        fprintf( stderr, "[ERROR] memory allocation\n" );
+        exit( EXIT_FAILURE );
+    }
 
-    } else {
-        *pptr = NULL;
+    if ( !block_read_all( &note->blocks, (uint8_t *)base, app->cfg.threads ) ) {
+        fprintf( stderr, "[ERROR] file \"%s\" corrupted\n", app->cfg.file_note );
+        exit( EXIT_FAILURE );
     }
 
-    return start;
+    //! The bytes after "kept" may have been appended since the blocks were read
+
+    if ( note->size > note->kept )
+        memcpy( base + note->kept, note->base, note->size - note->kept );
+
+    free( note->base );
+    note->base = base;
+    note->capacity = capacity;
+    note->kept = 0;
+    note->by_block = false;
+    block_close( &note->blocks );
 }
 
 // --------------------------------------
-/***** Read data from file (for printing) *****/
-void read_dat( int start, int end, AppGlobal *app ) {
-    FILE *In = fopen( app->cfg.file_note, "rb" );
+/***** Decompress the last block if it is not full, new notes are appended after it *****/
+static void load_tail( AppGlobal *app ) {
+    NotesBuffer *note = &app->note;
 
-    if ( !In ) {
-        fprintf( stderr, "[ERROR] file \"%s\" opening failed\n", app->cfg.file_note );
+    size_t kept = block_kept( &note->blocks );
+
+    if ( kept == 0 ) {
+        load_blocks( app );
+        return;
+    }
+
+    note->kept = kept;
+    size_t len = note->size - note->kept;
+
+    reserve_note( note, len );
+    if ( !block_read( &note->blocks, note->kept, len, (uint8_t *)note->base ) ) {
+        fprintf( stderr, "[ERROR] file \"%s\" corrupted\n", app->cfg.file_note );
         exit( EXIT_FAILURE );
     }
+}
 
-    if ( app->NDat.Body ) {
-        free( app->NDat.Body );
-        app->NDat.Body = NULL;
+// --------------------------------------
+/***** Grows a scratch buffer to hold "len" bytes *****/
+static char *reserve_scratch( char **buf, size_t *size, size_t len ) {
+    if ( len > *size ) {
+        char *grown = realloc( *buf, len );
+        if ( !grown ) {
+            fprintf( stderr, "[ERROR] memory allocation\n" );
+            exit( EXIT_FAILURE );
+        }
+        *buf = grown;
+        *size = len;
     }
+    return *buf;
+}
 
-    size_t size = (size_t)( end - start );
-    char *buffer = malloc( size + 1 );
-    if ( !buffer ) {
-        fclose( In );
-        fprintf( stderr, "[ERROR] memory allocation\n" );
+// --------------------------------------
+/***** Pointer to the bytes [start, end) of the notes, decompressed into "buf" if needed *****/
+static const char *note_bytes( AppGlobal *app, long start, long end, char **buf, size_t *size ) {
+    NotesBuffer *note = &app->note;
+
+    if ( !note->by_block || start >= (long)note->kept )
+        return note->base + ( start - note->kept );
+
+    //! Only the blocks holding the range are decompressed, the part after "kept" is already in memory
+
+    char *range = reserve_scratch( buf, size, end - start );
+    long head = ( end < (long)note->kept ? end : (long)note->kept ) - start;
+
+    if ( !block_read( &note->blocks, start, head, (uint8_t *)range ) ) {
+        fprintf( stderr, "[ERROR] file \"%s\" corrupted\n", app->cfg.file_note );
         exit( EXIT_FAILURE );
     }
 
-    fseek( In, start, SEEK_SET );
-    fread( buffer, 1, size, In );
-    buffer[size] = '\0';
+    if ( end - start > head )
+        memcpy( range + head, note->base, end - start - head );
+    return range;
+}
 
-    char *cursor = buffer;
-    char *token;
+// --------------------------------------
+/***** Pointer to the bytes [start, end) of the notes *****/
+static const char *note_range( AppGlobal *app, long start, long end ) {
+    return note_bytes( app, start, end, &app->note.range, &app->note.range_size );
+}
 
-    token = next_field( &cursor );
-    if ( token )
-        strncpy( app->NDat.Tag, token, sizeof( app->NDat.Tag ) - 1 );
+// --------------------------------------
+/***** Codec of the notes (the one in the config for new or uncompressed files) *****/
+const Codec *note_codec( AppGlobal *app ) {
+    return app->note.codec ? app->note.codec : codec_by_name( app->cfg.codec );
+}
 
-    token = next_field( &cursor );
-    if ( token )
-        strncpy( app->NDat.Comment, token, sizeof( app->NDat.Comment ) - 1 );
+// --------------------------------------
+/***** Access to the notes required by the command *****/
+NoteAccess note_access( Command cmd ) {
+
+    switch ( cmd ) {
+    case CMD_VIEW_NOTE:
+    case CMD_VIEW_TAG:
+    case CMD_FIND:
+    case CMD_BACKUP:
+        return NOTE_READ;
+
+    case CMD_ADD_NOTE:
+    case CMD_MODIFY:
+    case CMD_ORGANIZE:
+    case CMD_REMOVE:
+    case CMD_COMPACT:
+        return NOTE_WRITE;
+
+    default:
+        return NOTE_NONE;
+    }
+}
 
-    token = next_field( &cursor );
-    if ( token )
-        strncpy( app->NDat.Keywords, token, sizeof( app->NDat.Keywords ) - 1 );
+// --------------------------------------
+/***** Load the notes file in memory, decompressing it if needed *****/
+void load_note( AppGlobal *app, NoteAccess access ) {
+    NotesBuffer *note = &app->note;
+
+    memset( note, 0, sizeof( NotesBuffer ) );
 
-    token = next_field( &cursor );
-    if ( token )
-        strncpy( app->NDat.Link_File, token, sizeof( app->NDat.Link_File ) - 1 );
+    //! Readers share the file, a writer keeps it until the notes are compressed again
 
-    token = next_field( &cursor );
-    if ( token )
-        strncpy( app->NDat.Date, token, sizeof( app->NDat.Date ) - 1 );
+    if ( ( note->lock = open( app->cfg.file_note, O_RDONLY ) ) < 0 ) {
+        fprintf( stderr, "[ERROR] file \"%s\" opening failed\n", app->cfg.file_note );
+        exit( EXIT_FAILURE );
+    }
 
-    token = next_field( &cursor );
-    if ( token )
-        strncpy( app->NDat.Iv, token, sizeof( app->NDat.Iv ) - 1 );
+    if ( flock( note->lock, access == NOTE_WRITE ? LOCK_EX : LOCK_SH ) != 0 ) {
+        fprintf( stderr, "[ERROR] file \"%s\" lock failed\n", app->cfg.file_note );
+        exit( EXIT_FAILURE );
+    }
 
-    token = next_field( &cursor );
-    if ( token )
-        app->NDat.Protection = ( atoi( token ) != 0 );
+    //! Readers decompress single blocks on demand, writers also hold the last block to append to it
 
-    if ( cursor && *cursor ) {
-        char *end_marker = strstr( cursor, RECORD_DELIM );
-        if ( end_marker )
-            *end_marker = '\0';
+    if ( block_open( &note->blocks, note->lock ) ) {
+        note->size = note->blocks.header.raw_size;
+        note->kept = note->size;
+        note->by_block = true;
+        note->codec = note->blocks.codec;
 
-        app->NDat.Body = strdup( cursor );
-        if ( !app->NDat.Body ) {
-            free( buffer );
-            fclose( In );
-            fprintf( stderr, "[ERROR] memory allocation\n" );
-            exit( EXIT_FAILURE );
-        }
+        if ( access == NOTE_WRITE )
+            load_tail( app );
+        return;
+    }
+
+    //! Files compressed as a single stream
+
+    if ( huffman_decompress_buffer( app->cfg.file_note, (uint8_t **)&note->base, &note->size ) ) {
+        note->capacity = note->size;
+        return;
     }
 
-    free( buffer );
+    //! Empty or never compressed file
+
+    FILE *In;
+    if ( ( In = fopen( app->cfg.file_note, "rb" ) ) == NULL ) {
+        fprintf( stderr, "[ERROR] file \"%s\" opening failed\n", app->cfg.file_note );
+        exit( EXIT_FAILURE );
+    }
+
+    char chunk[8192];
+    size_t len;
+    while ( ( len = fread( chunk, 1, sizeof( chunk ), In ) ) > 0 )
+        write_note( note, chunk, len );
+
     fclose( In );
+    note->dirty = false;
 }
 
 // --------------------------------------
-/***** Write notes on the file *****/
-static void write_file( FILE *Out, TreeNode *root, NotesData *NDat ) {
-    root->data.start = ftell( Out );
+/***** Release the notes held in memory and the lock on the file *****/
+void release_note( AppGlobal *app ) {
+    if ( app->note.by_block )
+        block_close( &app->note.blocks );
+    free( app->note.range );
+    free( app->note.packed );
+    free( app->note.body );
+    free( app->note.base );
+    if ( app->note.lock > 0 )
+        close( app->note.lock );
+    memset( &app->note, 0, sizeof( NotesBuffer ) );
+}
 
-    if ( fprintf( Out,
-                  "%s" FIELD_DELIM "%s" FIELD_DELIM "%s" FIELD_DELIM "%s" FIELD_DELIM
-                  "%s" FIELD_DELIM "%s" FIELD_DELIM "%d" FIELD_DELIM,
-                  NDat->Tag, NDat->Comment, NDat->Keywords, NDat->Link_File, NDat->Date, NDat->Iv,
-                  NDat->Protection ? 1 : 0 ) < 0 ) {
-        fprintf( stderr, "[ERROR] file write failed\n" );
-        exit( EXIT_FAILURE );
+// --------------------------------------
+/***** Pointer to the bytes [start, end) of the notes, for the loader of the structure *****/
+static const char *tree_range( void *ctx, uint64_t start, uint64_t end ) {
+    return note_range( ctx, start, end );
+}
+
+// --------------------------------------
+/***** Load the structure (only the blocks holding the structures are decompressed) *****/
+TreeNode *load_note_tree( AppGlobal *app ) {
+    NotesBuffer *note = &app->note;
+    TreeNode *root = load_from_log( tree_range, app, note->size, &note->tree );
+
+    if ( root != NULL )
+        return root;
+
+    //! Notes without footer are searched for the structure as a whole
+
+    if ( note->by_block )
+        load_blocks( app );
+
+    return load_from_memory( app->root, &app->data, note->base, note->size );
+}
+
+// --------------------------------------
+/***** Returns the next field view delimited by FIELD_DELIM *****/
+static void next_view( const char **pptr, const char *end, FieldView *field ) {
+    const char *start = *pptr;
+
+    field->ptr = start;
+    field->len = 0;
+
+    if ( start == NULL )
+        return;
+
+    const char *pos = memmem( start, end - start, FIELD_DELIM, strlen( FIELD_DELIM ) );
+    if ( pos ) {
+        field->len = pos - start;
+        *pptr = pos + strlen( FIELD_DELIM );
+
+    } else {
+        field->len = end - start;
+        *pptr = NULL;
     }
+}
 
-    if ( NDat->Body != NULL ) {
-        if ( fprintf( Out, "%s", NDat->Body ) < 0 ) {
-            fprintf( stderr, "[ERROR] file write failed\n" );
-            exit( EXIT_FAILURE );
-        }
+// --------------------------------------
+/***** Decode a record written with the legacy delimiters *****/
+static void read_legacy( const char *cursor, const char *limit, NotesView *nv ) {
+
+    next_view( &cursor, limit, &nv->Tag );
+    next_view( &cursor, limit, &nv->Comment );
+    next_view( &cursor, limit, &nv->Keywords );
+    next_view( &cursor, limit, &nv->Link_File );
+    next_view( &cursor, limit, &nv->Date );
+    next_view( &cursor, limit, &nv->Iv );
+
+    FieldView flag;
+    next_view( &cursor, limit, &flag );
+    nv->Protection = ( flag.len > 0 && flag.ptr[0] != '0' );
+
+    if ( cursor ) {
+        const char *end_marker = memmem( cursor, limit - cursor, RECORD_DELIM, strlen( RECORD_DELIM ) );
+
+        nv->Body.ptr = cursor;
+        nv->Body.len = ( end_marker ? end_marker : limit ) - cursor;
     }
+}
 
-    if ( fprintf( Out, RECORD_DELIM ) < 0 ) {
-        fprintf( stderr, "[ERROR] file write failed\n" );
-        exit( EXIT_FAILURE );
+// --------------------------------------
+/***** Decode a length-prefixed record *****/
+static bool read_record( const char *cursor, const char *limit, NotesView *nv ) {
+    RecordHeader hdr;
+
+    if ( limit - cursor < (long)sizeof( hdr ) )
+        return false;
+
+    memcpy( &hdr, cursor, sizeof( hdr ) );
+    cursor += sizeof( hdr );
+
+    bool split = hdr.magic == RECORD_MAGIC_SPLIT;
+    if ( split ) {
+        if ( limit - cursor < (long)sizeof( BodyRef ) )
+            return false;
+        memcpy( &nv->Ref, cursor, sizeof( BodyRef ) );
+        cursor += sizeof( BodyRef );
+    }
+
+    FieldView *fields[RECORD_FIELDS] = { &nv->Tag,  &nv->Comment, &nv->Keywords,
+                                         &nv->Link_File, &nv->Date, &nv->Iv };
+
+    for ( int i = 0; i < RECORD_FIELDS; i++ ) {
+        if ( limit - cursor < hdr.len[i] )
+            return false;
+        fields[i]->ptr = cursor;
+        fields[i]->len = hdr.len[i];
+        cursor += hdr.len[i];
+    }
+
+    nv->Protection = ( hdr.flags & RECORD_PROTECTED ) != 0;
+    nv->Body.len = hdr.body_len;
+
+    //! A body stored apart is read only when it is needed
+
+    if ( split ) {
+        nv->Body.ptr = NULL;
+        return ( hdr.body_len == 0 ) == ( nv->Ref.length == 0 );
     }
 
-    root->data.end = ftell( Out );
+    if ( (size_t)( limit - cursor ) < hdr.body_len )
+        return false;
+    nv->Body.ptr = cursor;
+
+    return true;
 }
 
 // --------------------------------------
-/***** Read notes from the file (for writing) *****/
-static void read_file( FILE *In, int start, int end, NotesData *NDat ) {
-    fseek( In, start, SEEK_SET );
+/***** Read data from file (for printing) *****/
+void read_dat( long start, long end, AppGlobal *app ) {
+    NotesView *nv = &app->NView;
 
-    memset( NDat, 0, sizeof( NotesData ) );
-    if ( NDat->Body != NULL ) {
-        free( NDat->Body );
-        NDat->Body = NULL;
-    }
+    memset( nv, 0, sizeof( NotesView ) );
 
-    size_t size = end - start;
-    char *buffer = malloc( size + 1 );
-    if ( !buffer ) {
-        fprintf( stderr, "[ERROR] memory allocation\n" );
+    if ( end <= start || end == BLOCK_NO_RECORD ) // root
+        return;
+
+    if ( (size_t)end > app->note.size ) {
+        fprintf( stderr, "[ERROR] file \"%s\" corrupted\n", app->cfg.file_note );
         exit( EXIT_FAILURE );
     }
 
-    fread( buffer, 1, size, In );
-    buffer[size] = '\0';
+    const char *cursor = note_range( app, start, end );
+    const char *limit = cursor + ( end - start );
 
-    char *cursor = buffer;
-    char *token;
+    if ( (uint8_t)*cursor != RECORD_MAGIC && (uint8_t)*cursor != RECORD_MAGIC_SPLIT )
+        read_legacy( cursor, limit, nv );
 
-    token = next_field( &cursor );
-    if ( token )
-        strncpy( NDat->Tag, token, sizeof( NDat->Tag ) - 1 );
+    else if ( !read_record( cursor, limit, nv ) ) {
+        fprintf( stderr, "[ERROR] file \"%s\" corrupted\n", app->cfg.file_note );
+        exit( EXIT_FAILURE );
+    }
+}
 
-    token = next_field( &cursor );
-    if ( token )
-        strncpy( NDat->Comment, token, sizeof( NDat->Comment ) - 1 );
+// --------------------------------------
+/***** Compressed body of a record, as stored in the notes *****/
+static const char *packed_body( const NotesView *nv, AppGlobal *app ) {
+    if ( nv->Ref.offset + nv->Ref.length > app->note.size ) {
+        fprintf( stderr, "[ERROR] file \"%s\" corrupted\n", app->cfg.file_note );
+        exit( EXIT_FAILURE );
+    }
 
-    token = next_field( &cursor );
-    if ( token )
-        strncpy( NDat->Keywords, token, sizeof( NDat->Keywords ) - 1 );
+    return note_bytes( app, nv->Ref.offset, nv->Ref.offset + nv->Ref.length, &app->note.packed,
+                       &app->note.packed_size );
+}
 
-    token = next_field( &cursor );
-    if ( token )
-        strncpy( NDat->Link_File, token, sizeof( NDat->Link_File ) - 1 );
+// --------------------------------------
+/***** Load the body of the record read by read_dat, if it is stored apart *****/
+void read_body( NotesView *nv, AppGlobal *app ) {
+    if ( nv->Body.ptr || nv->Body.len == 0 )
+        return;
 
-    token = next_field( &cursor );
-    if ( token )
-        strncpy( NDat->Date, token, sizeof( NDat->Date ) - 1 );
+    const char *packed = packed_body( nv, app );
+    char *body = reserve_scratch( &app->note.body, &app->note.body_size, nv->Body.len );
+
+    if ( !codec_unpack( nv->Ref.type, (const uint8_t *)packed, nv->Ref.length, (uint8_t *)body, nv->Body.len ) ) {
+        fprintf( stderr, "[ERROR] file \"%s\" corrupted\n", app->cfg.file_note );
+        exit( EXIT_FAILURE );
+    }
+
+    nv->Body.ptr = body;
+}
 
-    token = next_field( &cursor );
-    if ( token )
-        strncpy( NDat->Iv, token, sizeof( NDat->Iv ) - 1 );
+// --------------------------------------
+/***** Copy a field view into a fixed size string *****/
+static void view_to_str( char *dest, size_t size, const FieldView *field ) {
+    size_t len = field->len < size - 1 ? field->len : size - 1;
 
-    token = next_field( &cursor );
-    if ( token )
-        NDat->Protection = ( atoi( token ) != 0 );
+    memmove( dest, field->ptr, len );
+    dest[len] = '\0';
+}
 
-    if ( cursor && *cursor ) {
-        char *end_marker = strstr( cursor, RECORD_DELIM );
-        if ( end_marker )
-            *end_marker = '\0';
+// --------------------------------------
+/***** Copies the fields read by read_dat into "NotesData" *****/
+void view_to_ndat( const NotesView *nv, NotesData *n ) {
+
+    view_to_str( n->Tag, sizeof( n->Tag ), &nv->Tag );
+    view_to_str( n->Comment, sizeof( n->Comment ), &nv->Comment );
+    view_to_str( n->Keywords, sizeof( n->Keywords ), &nv->Keywords );
+    view_to_str( n->Link_File, sizeof( n->Link_File ), &nv->Link_File );
+    view_to_str( n->Date, sizeof( n->Date ), &nv->Date );
+    view_to_str( n->Iv, sizeof( n->Iv ), &nv->Iv );
+    n->Protection = nv->Protection;
+
+    if ( n->Body ) {
+        free( n->Body );
+        n->Body = NULL;
+    }
 
-        NDat->Body = strdup( cursor );
-        if ( !NDat->Body ) {
-            free( buffer );
+    if ( nv->Body.len ) {
+        n->Body = malloc( nv->Body.len + 1 );
+        if ( !n->Body ) {
             fprintf( stderr, "[ERROR] memory allocation\n" );
             exit( EXIT_FAILURE );
         }
+        view_to_str( n->Body, nv->Body.len + 1, &nv->Body );
     }
+}
 
-    free( buffer );
+// --------------------------------------
+/***** Points the field views to the strings of "NotesData" *****/
+void ndat_to_view( NotesData *n, NotesView *nv ) {
+
+    nv->Tag = (FieldView){ n->Tag, strlen( n->Tag ) };
+    nv->Comment = (FieldView){ n->Comment, strlen( n->Comment ) };
+    nv->Keywords = (FieldView){ n->Keywords, strlen( n->Keywords ) };
+    nv->Link_File = (FieldView){ n->Link_File, strlen( n->Link_File ) };
+    nv->Date = (FieldView){ n->Date, strlen( n->Date ) };
+    nv->Iv = (FieldView){ n->Iv, strlen( n->Iv ) };
+    nv->Body = (FieldView){ n->Body, n->Body ? strlen( n->Body ) : 0 };
+    nv->Protection = n->Protection;
+    nv->Ref = (BodyRef){ 0 };
 }
 
 // --------------------------------------
-/***** Traverses the tree structure to read and write data to the file *****/
-static void scroll_tree( TreeNode *root, NotesData *tmpNDat, FILE *In, FILE *Out, AppGlobal *app ) {
+/***** Write the body apart from its record, compressed on its own *****/
+static BodyRef write_body( NotesBuffer *Out, const NotesView *nv, AppGlobal *app ) {
+    BodyRef ref = { Out->size, 0, BLOCK_STORED };
 
-    if ( root == NULL ) {
-        return;
+    if ( nv->Body.len == 0 )
+        return ref;
+
+    const Codec *codec = note_codec( app );
+
+    //! Bodies already compressed with the codec of the notes are copied as they are
+
+    if ( !nv->Body.ptr && ( nv->Ref.type == codec->type || nv->Ref.type == BLOCK_STORED ) ) {
+        ref.length = nv->Ref.length;
+        ref.type = nv->Ref.type;
+        write_note( Out, packed_body( nv, app ), ref.length );
+        return ref;
     }
 
-    if ( root->data.end == 0 )
-        copy_ndat( &app->NDat, tmpNDat );
+    NotesView body = *nv;
+    read_body( &body, app );
 
-    else
-        read_file( In, root->data.start, root->data.end, &app->NDat );
+    uint8_t *packed = malloc( codec->bound( body.Body.len ) );
+    if ( !packed ) {
+        fprintf( stderr, "[ERROR] memory allocation\n" );
+        exit( EXIT_FAILURE );
+    }
 
-    if ( root->data.end != -1 )
-        write_file( Out, root, &app->NDat );
+    ref.length = codec_pack( codec, (const uint8_t *)body.Body.ptr, body.Body.len, packed, &ref.type );
+    write_note( Out, packed, ref.length );
+    free( packed );
 
-    scroll_tree( root->firstChild, tmpNDat, In, Out, app );
-    scroll_tree( root->nextSibling, tmpNDat, In, Out, app );
+    return ref;
 }
 
 // --------------------------------------
-/***** Rewrites the notes file with the changes *****/
-void save_note( NotesData *tmpNDat, AppGlobal *app ) {
+/***** Write notes on the buffers (the body goes in "Bodies") *****/
+static void write_file( NotesBuffer *Bodies, NotesBuffer *Out, TreeNode *root, const NotesView *nv, AppGlobal *app ) {
+    BodyRef ref = write_body( Bodies, nv, app );
+    size_t start = Out->size;
+
+    const FieldView *fields[RECORD_FIELDS] = { &nv->Tag,       &nv->Comment, &nv->Keywords,
+                                               &nv->Link_File, &nv->Date,    &nv->Iv };
+
+    RecordHeader hdr = { 0 };
+    hdr.magic = RECORD_MAGIC_SPLIT;
+    hdr.flags = nv->Protection ? RECORD_PROTECTED : 0;
+    for ( int i = 0; i < RECORD_FIELDS; i++ )
+        hdr.len[i] = fields[i]->len;
+    hdr.body_len = nv->Body.len;
+
+    write_note( Out, &hdr, sizeof( hdr ) );
+    write_note( Out, &ref, sizeof( ref ) );
+    for ( int i = 0; i < RECORD_FIELDS; i++ )
+        write_note( Out, fields[i]->ptr, fields[i]->len );
+
+    //! Offsets of the nodes are 32 bits, the bodies kept apart end up before the records
+
+    if ( Out->size + ( Bodies != Out ? Bodies->size : 0 ) >= BLOCK_NO_RECORD ) {
+        fprintf( stderr, "[ERROR] notes file too large\n" );
+        exit( EXIT_FAILURE );
+    }
 
-    FILE *In;
-    FILE *Out;
+    block_set_record( &root->data, start, Out->size );
+}
 
-    char old[201];
+// --------------------------------------
+/***** Write a new or modified note on the file *****/
+static void write_ndat( NotesBuffer *Bodies, NotesBuffer *Out, TreeNode *root, NotesData *tmpNDat, AppGlobal *app ) {
+    NotesView nv;
 
-    strcpy( old, app->cfg.file_note );
-    strcat( old, "_old" );
-    rename( app->cfg.file_note, old );
+    copy_ndat( &app->NDat, tmpNDat );
+    ndat_to_view( &app->NDat, &nv );
+    write_file( Bodies, Out, root, &nv, app );
+}
 
-    if ( ( In = fopen( old, "rb" ) ) == NULL ) {
-        fprintf( stderr, "[ERROR] file \"%s\" opening failed\n", old );
-        exit( EXIT_FAILURE );
+// --------------------------------------
+/***** Traverses the tree structure to read and write data to the file *****/
+static void scroll_tree( TreeNode *root, NotesData *tmpNDat, NotesBuffer *Bodies, NotesBuffer *Out, AppGlobal *app ) {
+    TreeIter it;
+    TreeNode *node;
+
+    tree_iter_init( &it, root, true );
+    while ( ( node = tree_iter_next( &it ) ) != NULL ) {
+        if ( node->data.end == 0 )
+            write_ndat( Bodies, Out, node, tmpNDat, app );
+
+        else if ( node->data.end != BLOCK_NO_RECORD ) {
+            read_dat( node->data.start, node->data.end, app );
+            write_file( Bodies, Out, node, &app->NView, app );
+        }
     }
+}
 
-    if ( ( Out = fopen( app->cfg.file_note, "wb" ) ) == NULL ) {
-        fprintf( stderr, "[ERROR] file \"%s\" creation failed\n", app->cfg.file_note );
-        exit( EXIT_FAILURE );
+// --------------------------------------
+/***** Appends the new or modified notes to the end of the file *****/
+static void append_tree( TreeNode *root, NotesData *tmpNDat, NotesBuffer *Out, AppGlobal *app ) {
+    TreeIter it;
+    TreeNode *node;
+
+    tree_iter_init( &it, root, true );
+    while ( ( node = tree_iter_next( &it ) ) != NULL ) {
+        if ( node->data.end == 0 ) {
+            size_t size = Out->size;
+
+            write_ndat( Out, Out, node, tmpNDat, app );
+            Out->tree.live += Out->size - size;
+        }
     }
+}
 
-    scroll_tree( app->root, tmpNDat, In, Out, app );
+// --------------------------------------
+/***** Moves the records of the tree by "delta" bytes *****/
+static void shift_tree( TreeNode *root, long delta ) {
+    TreeIter it;
+    TreeNode *node;
+
+    tree_iter_init( &it, root, true );
+    while ( ( node = tree_iter_next( &it ) ) != NULL ) {
+        if ( node->data.end > 0 && node->data.end != BLOCK_NO_RECORD )
+            block_set_record( &node->data, node->data.start + delta, node->data.end + delta );
+    }
+}
 
-    fclose( In );
-    fclose( Out );
+// --------------------------------------
+/***** Bytes of the record of a node with its body (0 if it has none) *****/
+static long record_size( TreeNode *node, AppGlobal *app ) {
+    if ( node->data.end == 0 || node->data.end == BLOCK_NO_RECORD )
+        return 0;
 
-    remove( old );
+    read_dat( node->data.start, node->data.end, app );
+    return node->data.end - node->data.start + app->NView.Ref.length;
 }
 
 // --------------------------------------
-/***** Copy the current note file *****/
-void copy_file( char *original_file, char *new_file ) {
+/***** Sum of the bytes still referenced by the tree (records and bodies) *****/
+static long live_size( TreeNode *root, AppGlobal *app ) {
+    TreeIter it;
+    TreeNode *node;
+    long size = 0;
 
-    FILE *In;
-    FILE *Out;
+    tree_iter_init( &it, root, true );
+    while ( ( node = tree_iter_next( &it ) ) != NULL )
+        size += record_size( node, app );
 
-    if ( ( In = fopen( original_file, "rb" ) ) == NULL ) {
-        fprintf( stderr, "[ERROR] file \"%s\" opening failed\n", original_file );
-        exit( EXIT_FAILURE );
-    }
+    return size;
+}
+
+// --------------------------------------
+/***** Bytes of the notes referenced by the tree, counted only if the footer does not hold them *****/
+static void count_live( AppGlobal *app ) {
+    if ( app->note.tree.live == 0 )
+        app->note.tree.live = live_size( app->root, app );
+}
+
+// --------------------------------------
+/***** Leaves the record of the note to the next compaction, the note is written again by save_note *****/
+void discard_note( TreeNode *node, AppGlobal *app ) {
+    count_live( app );
+    app->note.tree.live -= record_size( node, app );
+    block_set_record( &node->data, 0, 0 );
+}
+
+// --------------------------------------
+/***** Removes the note with its descendants, their records are left to the next compaction *****/
+void remove_note( TreeNode *node, AppGlobal *app ) {
+    TreeIter it;
+    TreeNode *child;
+
+    if ( node == NULL )
+        return;
+
+    count_live( app );
+
+    tree_iter_init( &it, node, false );
+    while ( ( child = tree_iter_next( &it ) ) != NULL )
+        app->note.tree.live -= record_size( child, app );
+
+    app->root = remove_node( app->root, node );
+}
+
+// --------------------------------------
+/***** Rewrites the notes keeping only the live records *****/
+void compact_note( NotesData *tmpNDat, AppGlobal *app ) {
+
+    NotesBuffer Bodies = { 0 }, Records = { 0 };
+
+    //! The offsets of every node change, and so do the columns holding them
+
+    note_indexes_free( app );
+
+    //! Every record is read again, the whole notes are decompressed at once
+
+    if ( app->note.by_block )
+        load_blocks( app );
+
+    //! The records are read from the current buffer while the new ones are filled
+
+    scroll_tree( app->root, tmpNDat, &Bodies, &Records, app );
 
-    if ( ( Out = fopen( new_file, "wb" ) ) == NULL ) {
-        fprintf( stderr, "[ERROR] file \"%s\" creation failed\n", new_file );
+    //! Bodies first, so the records lie together next to the structure at the end
+
+    shift_tree( app->root, Bodies.size );
+    write_note( &Bodies, Records.base, Records.size );
+    free( Records.base );
+
+    free( app->note.base );
+    app->note.base = Bodies.base;
+    app->note.kept = 0;
+    app->note.size = Bodies.size;
+    app->note.capacity = Bodies.capacity;
+    app->note.dirty = true;
+
+    //! Every byte left is referenced, the next structure is saved whole
+
+    app->note.tree.live = Bodies.size;
+    app->note.tree.end = 0;
+    app->note.tree.bytes = 0;
+}
+
+// --------------------------------------
+/***** Appends the changes to the notes (log-structured) *****/
+void save_note( NotesData *tmpNDat, AppGlobal *app ) {
+
+    //! The tree has been changed by the command, the indexes may point to removed nodes
+
+    note_indexes_free( app );
+
+    count_live( app );
+    append_tree( app->root, tmpNDat, &app->note, app );
+
+    //! The structures still needed to load the tree are not dead
+
+    long live = app->note.tree.live;
+    long dead = (long)app->note.size - live - (long)app->note.tree.bytes;
+
+    //! Superseded records and structures are reclaimed once they outweigh the live data
+
+    if ( dead > COMPACT_MIN_DEAD && dead > live )
+        compact_note( NULL, app );
+}
+
+// --------------------------------------
+/***** Appends the changes of the structure at the end of the notes *****/
+void save_tree( AppGlobal *app ) {
+    size_t len;
+    char *tree = save_to_memory( app->root, app->note.size, &app->note.tree, &len );
+
+    write_note( &app->note, tree, len );
+    free( tree );
+}
+
+// --------------------------------------
+/***** Write the notes held in memory to a file *****/
+void backup_note( const char *backup, AppGlobal *app ) {
+
+    FILE *Out;
+
+    if ( ( Out = fopen( backup, "wb" ) ) == NULL ) {
+        fprintf( stderr, "[ERROR] file \"%s\" creation failed\n", backup );
         exit( EXIT_FAILURE );
     }
 
-    char ch = fgetc( In );
+    const char *notes = note_range( app, 0, app->note.size );
 
-    while ( !feof( In ) ) {
-        fputc( ch, Out );
-        ch = fgetc( In );
+    if ( fwrite( notes, 1, app->note.size, Out ) != app->note.size ) {
+        fprintf( stderr, "[ERROR] file write failed\n" );
+        exit( EXIT_FAILURE );
     }
 
-    fclose( In );
     fclose( Out );
 }
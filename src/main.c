@@ -50,41 +50,34 @@ int main( int argc, char *argv[] ) {
     if ( parse_arguments( argc, argv, &app.opts ) != 0 )
         return 1;
 
-    //! Unzip files
+    //! Unzip the notes in memory (only if the command uses them)
 
     char original_file[300];
-
     strcpy( original_file, app.cfg.file_note );
-    strcat( app.cfg.file_note, "..." );
-
-    if ( !huffman_decompress_file( original_file, app.cfg.file_note ) )
-        copy_file( original_file, app.cfg.file_note );
-
-    //! Calculate sha1 of the file at the beginning
 
-    char hash_start[41];
-    sha1_file( app.cfg.file_note, hash_start );
+    NoteAccess access = note_access( app.opts.cmd );
 
     //! Initialize "data" and "root"
 
     init_blockinfo( &app.data );
-    app.root = load_from_file( app.root, &app.data, app.cfg.file_note );
 
-    controller( SetFile, Passwd, Key, &app );
-
-    free_tree( app.root );
+    if ( access != NOTE_NONE ) {
+        load_note( &app, access );
+        app.root = load_note_tree( &app );
+    }
 
-    //! Calculate sha1 of the file at the end
+    controller( SetFile, Passwd, Key, &app );
 
-    char hash_end[41];
-    sha1_file( app.cfg.file_note, hash_end );
+    note_indexes_free( &app );
+    free_tree_arena();
 
-    //! If the file has changed, compress it.
+    //! If the notes have changed, compress the blocks after the last kept one into the original file
 
-    if ( strcmp( hash_start, hash_end ) )
-        huffman_compress_file( app.cfg.file_note, original_file );
+    if ( access == NOTE_WRITE && app.note.dirty )
+        block_write( original_file, app.note.by_block ? &app.note.blocks : NULL, (const uint8_t *)app.note.base,
+                     app.note.kept, app.note.size, note_codec( &app ), app.cfg.threads );
 
-    remove( app.cfg.file_note );
+    release_note( &app );
 
     return 0;
 }
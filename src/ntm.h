@@ -25,11 +25,14 @@
 #include "Module_Tree/Tree_Structure.h"
 #include "Module_Date_Search/Date_Search.h"
 #include "Module_Compression/Huffman_Coding.h"
+#include "Module_Compression/Block_Container.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <sys/wait.h>
 #include <libgen.h>
+#include <fcntl.h>
+#include <sys/file.h>
 
 // Program details
 #define NAME "NotaMy"
@@ -45,10 +48,19 @@
 // Default tag
 #define DEFAULT_TAG "?"
 
-// Default delimiter file
+// Default delimiter file (legacy records)
 #define FIELD_DELIM "<::>"
 #define RECORD_DELIM "<::END::>\n"
 
+// Binary records
+#define RECORD_MAGIC 0x1E       // Body after the fields
+#define RECORD_MAGIC_SPLIT 0x1F // Body compressed on its own and stored apart
+#define RECORD_PROTECTED 0x01
+#define RECORD_FIELDS 6
+
+// Dead bytes tolerated in the notes file before it is compacted
+#define COMPACT_MIN_DEAD 65536
+
 typedef struct { //! Notes
     char Tag[50];
     char Comment[480];
@@ -60,6 +72,64 @@ typedef struct { //! Notes
     bool Protection;
 } NotesData;
 
+typedef struct { //! Header of a binary record, followed by the fields and the body
+    uint8_t magic;
+    uint8_t flags;
+    uint16_t len[RECORD_FIELDS]; // Tag, Comment, Keywords, Link_File, Date, Iv
+    uint16_t reserved;
+    uint32_t body_len;
+} RecordHeader;
+
+typedef struct { //! Position of a body stored apart, follows the header of the record
+    uint64_t offset; // Position in the notes
+    uint32_t length; // Compressed length (0 = no body)
+    uint32_t type;   // Block type of the codec (BLOCK_STORED if not compressed)
+} BodyRef;
+
+typedef struct { //! View on a field of the notes buffer
+    const char *ptr;
+    size_t len;
+} FieldView;
+
+typedef struct { //! Notes read without copies
+    FieldView Tag;
+    FieldView Comment;
+    FieldView Keywords;
+    FieldView Link_File;
+    FieldView Date;
+    FieldView Iv;
+    FieldView Body; // "ptr" is NULL until read_body loads a body stored apart
+    bool Protection;
+    BodyRef Ref; // Body stored apart (length 0 if inline or missing)
+} NotesView;
+
+typedef enum { //! Access to the notes required by a command
+    NOTE_NONE,  // The notes are not read
+    NOTE_READ,  // Shared lock, never written back
+    NOTE_WRITE  // Exclusive lock, compressed again if changed
+} NoteAccess;
+
+typedef struct { //! Decompressed notes file held in memory
+    char *base;      // Notes from "kept" to "size"
+    size_t kept;     // Notes left in the blocks of the file (0 = all of them in "base")
+    size_t size;     // Size of the whole notes
+    size_t capacity; // Room in "base"
+    bool dirty;      // Changed since it was loaded
+    int lock;        // Descriptor holding the lock on the notes file
+
+    bool by_block;      // Read block by block from the compressed file (writers hold the notes after "kept")
+    BlockReader blocks; // Index of the compressed file
+    char *range;        // Last range decompressed from the blocks
+    size_t range_size;
+    char *packed; // Last compressed body read from the notes
+    size_t packed_size;
+    char *body; // Last body decompressed
+    size_t body_size;
+
+    const Codec *codec; // Codec of the file (NULL = the one in the config)
+    TreeLog tree;       // Structures saved at the end of the notes
+} NotesBuffer;
+
 typedef struct { //! AppGlobal
     Config cfg;
     Style stl;
@@ -67,7 +137,12 @@ typedef struct { //! AppGlobal
     Protect ctx;
     BlockInfo data;
     TreeNode *root;
+    HashIndex hashes; // Built on the first search by hash, released when the tree changes
+    TagIndex tags;    // Built on the first search by tag, released when the tree changes
+    TreeColumns cols; // Built on the first scan of the metadata, released when the tree changes
     NotesData NDat;
+    NotesView NView;
+    NotesBuffer note;
 } AppGlobal;
 
 #include "common_utils.c"
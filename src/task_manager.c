@@ -54,8 +54,8 @@ void controller( char *SetFile, char *Passwd, char *Key, AppGlobal *app ) {
 
         generate_sha1( &app->NDat, app );
 
-        strcpy( app->data.tag, app->NDat.Tag );
-        strcpy( app->data.date, app->NDat.Date );
+        block_set_tag( &app->data, app->NDat.Tag );
+        block_set_date( &app->data, app->NDat.Date );
 
         if ( app->opts.with_protection == true ) {
             init_ctx_from_ndat( &app->ctx, &app->NDat );
@@ -68,57 +68,42 @@ void controller( char *SetFile, char *Passwd, char *Key, AppGlobal *app ) {
             app->root = insert_node( app->root, &app->data );
 
         else {
-            int cont = 0;
+            TreeNode *parentNode;
             find = find_tag_node;
 
-            check_duplicate( app->root, parent_tag, find, &cont );
-            if ( cont > 1 ) {
-                int cont = 0;
-
+            if ( tag_index_find( note_tags( app ), parent_tag, &parentNode ) > 1 ) {
                 printf( "[WARNING] ambiguous tag\ndo you want to specify a hash? [Y/n]\n" );
                 char ch = getchar();
 
                 if ( ch != 'y' && ch != 'Y' && ch != '\n' ) {
                     exit( 0 );
                 }
-                print_find_node( app->root, parent_tag, find, app );
+                print_find_node( parent_tag, find, app );
                 char hash[41] = { '\0' };
                 printf( "Enter hash ->" );
                 scanf( "%40s", hash );
-                find = find_hash_node;
-                check_duplicate( app->root, hash, find, &cont );
 
-                if ( cont > 1 ) {
-                    fprintf( stderr, "[ERROR] duplicate hash \n" );
-                    exit( EXIT_FAILURE );
-                }
-
-                else {
-                    TreeNode *parentNode = find_node( app->root, hash, find );
-                    if ( parentNode == NULL ) {
-                        fprintf( stderr, "[ERROR] %s not found \n", hash );
-                        exit( EXIT_FAILURE );
-                    }
-
-                    else {
-                        insert_node( parentNode, &app->data );
-                    }
-                }
-            } else {
-                TreeNode *parentNode = find_node( app->root, parent_tag, find );
+                parentNode = find_hash( app, hash );
                 if ( parentNode == NULL ) {
-                    fprintf( stderr, "[ERROR] %s not found \n", parent_tag );
+                    fprintf( stderr, "[ERROR] %s not found \n", hash );
                     exit( EXIT_FAILURE );
                 }
 
                 else {
                     insert_node( parentNode, &app->data );
                 }
+            } else if ( parentNode == NULL ) {
+                fprintf( stderr, "[ERROR] %s not found \n", parent_tag );
+                exit( EXIT_FAILURE );
+            }
+
+            else {
+                insert_node( parentNode, &app->data );
             }
         }
 
         save_note( &tmpNDat, app );
-        save_to_file( app->root, app->cfg.file_note );
+        save_tree( app );
         break;
     }
 
@@ -153,49 +138,42 @@ void controller( char *SetFile, char *Passwd, char *Key, AppGlobal *app ) {
             int size = strlen( app->NDat.Tag ) - 1;
             find = find_tag_node;
             if ( app->opts.with_file_flag == true ) {
-                int cont = 0;
-                check_duplicate( app->root, app->NDat.Tag, find, &cont );
+                TreeNode *node;
 
-                if ( cont > 1 ) {
-                    cont = 0;
+                if ( tag_index_find( note_tags( app ), app->NDat.Tag, &node ) > 1 ) {
                     printf( "[WARNING] ambiguous tag\ndo you want to specify a hash? [Y/n]\n" );
                     char ch = getchar();
 
                     if ( ch != 'y' && ch != 'Y' && ch != '\n' ) {
                         exit( 0 );
                     }
-                    print_find_node( app->root, app->NDat.Tag, find, app );
+                    print_find_node( app->NDat.Tag, find, app );
 
                     char hash[41] = { '\0' };
                     printf( "Enter hash ->" );
                     scanf( "%40s", hash );
-                    find = find_hash_node;
-                    check_duplicate( app->root, hash, find, &cont );
 
-                    if ( cont > 1 ) {
-                        fprintf( stderr, "[ERROR] duplicate hash \n" );
-                        exit( EXIT_FAILURE );
-                    }
-
-                    else
-                        print_find( app->root, hash, find, app, Passwd, Key );
+                    find_hash( app, hash );
+                    print_find( hash, find_hash_node, app, Passwd, Key );
                 } else
-                    print_find( app->root, app->NDat.Tag, find, app, Passwd, Key );
+                    print_find( app->NDat.Tag, find, app, Passwd, Key );
             }
 
             else {
                 if ( app->NDat.Tag[size] == '+' ) {
                     app->NDat.Tag[size] = '\0';
-                    TreeNode *parentNode = find_node( app->root, app->NDat.Tag, find );
+                    TreeNode *parentNode;
+                    tag_index_find( note_tags( app ), app->NDat.Tag, &parentNode );
                     print_children( parentNode, app, Passwd, Key );
 
                 } else if ( app->NDat.Tag[size] == '-' ) {
                     app->NDat.Tag[size] = '\0';
-                    TreeNode *parentNode = find_node( app->root, app->NDat.Tag, find );
+                    TreeNode *parentNode;
+                    tag_index_find( note_tags( app ), app->NDat.Tag, &parentNode );
 
                     print_sibling( parentNode, app, Passwd, Key );
                 } else {
-                    print_find( app->root, app->NDat.Tag, find, app, Passwd, Key );
+                    print_find( app->NDat.Tag, find, app, Passwd, Key );
                 }
             }
         } else if ( app->opts.arg_hash ) {
@@ -203,18 +181,18 @@ void controller( char *SetFile, char *Passwd, char *Key, AppGlobal *app ) {
             find = find_hash_node;
             if ( app->opts.arg_hash[size] == '+' ) {
                 app->opts.arg_hash[size] = '\0';
-                TreeNode *parentNode = find_node( app->root, app->opts.arg_hash, find );
+                TreeNode *parentNode = find_hash( app, app->opts.arg_hash );
                 print_children( parentNode, app, Passwd, Key );
 
             } else if ( app->opts.arg_hash[size] == '-' ) {
                 app->opts.arg_hash[size] = '\0';
-                TreeNode *parentNode = find_node( app->root, app->opts.arg_hash, find );
+                TreeNode *parentNode = find_hash( app, app->opts.arg_hash );
                 print_sibling( parentNode, app, Passwd, Key );
             } else {
-                print_find( app->root, app->opts.arg_hash, find, app, Passwd, Key );
+                print_find( app->opts.arg_hash, find, app, Passwd, Key );
             }
         } else if ( app->opts.arg_date )
-            process_data( app->root, app );
+            process_data( app );
         else if ( app->opts.arg_keywords )
             print_find_keywords( app->root, app->opts.arg_keywords, app );
         break;
@@ -235,16 +213,7 @@ void controller( char *SetFile, char *Passwd, char *Key, AppGlobal *app ) {
         if ( strlen( app->NDat.Keywords ) != 0 )
             strcpy( tmpNDat.Keywords, app->NDat.Keywords );
 
-        int cont = 0;
-        find = find_hash_node;
-        check_duplicate( app->root, app->opts.arg_hash, find, &cont );
-        if ( cont > 1 ) {
-            fprintf( stderr, "[ERROR] duplicate hash \n" );
-            exit( EXIT_FAILURE );
-        }
-
-        find = find_hash_node;
-        TreeNode *node = find_node( app->root, app->opts.arg_hash, find );
+        TreeNode *node = find_hash( app, app->opts.arg_hash );
 
         if ( node == NULL ) {
             fprintf( stderr, "[ERROR] not found \n" );
@@ -252,6 +221,8 @@ void controller( char *SetFile, char *Passwd, char *Key, AppGlobal *app ) {
         }
 
         read_dat( node->data.start, node->data.end, app );
+        read_body( &app->NView, app );
+        view_to_ndat( &app->NView, &app->NDat );
         if ( app->NDat.Protection ) {
             init_ctx_from_ndat( &app->ctx, &app->NDat );
             if ( app->opts.with_protection )
@@ -262,8 +233,7 @@ void controller( char *SetFile, char *Passwd, char *Key, AppGlobal *app ) {
             }
         }
 
-        node->data.start = 0;
-        node->data.end = 0;
+        discard_note( node, app );
 
         if ( strlen( tmpNDat.Comment ) != 0 )
             strcpy( app->NDat.Comment, tmpNDat.Comment );
@@ -276,7 +246,7 @@ void controller( char *SetFile, char *Passwd, char *Key, AppGlobal *app ) {
 
         if ( strlen( tmpNDat.Tag ) != 0 ) {
             strcpy( app->NDat.Tag, tmpNDat.Tag );
-            strcpy( node->data.tag, tmpNDat.Tag );
+            block_set_tag( &node->data, tmpNDat.Tag );
         }
 
         if ( app->opts.with_body == true )
@@ -290,7 +260,7 @@ void controller( char *SetFile, char *Passwd, char *Key, AppGlobal *app ) {
         copy_ndat( &tmpNDat, &app->NDat );
 
         save_note( &tmpNDat, app );
-        save_to_file( app->root, app->cfg.file_note );
+        save_tree( app );
         break;
     }
 
@@ -301,87 +271,66 @@ void controller( char *SetFile, char *Passwd, char *Key, AppGlobal *app ) {
             exit( EXIT_FAILURE );
         }
 
-        int contD = 0, contS = 0;
-        find = find_hash_node;
+        TreeNode *destination, *source;
 
-        check_duplicate( app->root, app->opts.arg_generic, find, &contD );
-        if ( contD > 1 ) {
+        if ( hash_index_find( note_hashes( app ), app->opts.arg_generic, &destination ) == HASH_AMBIGUOUS ) {
             fprintf( stderr, "[ERROR] duplicate destination \n" );
             exit( EXIT_FAILURE );
         }
 
-        check_duplicate( app->root, app->opts.arg_hash, find, &contS );
-        if ( contS > 1 ) {
+        if ( hash_index_find( note_hashes( app ), app->opts.arg_hash, &source ) == HASH_AMBIGUOUS ) {
             fprintf( stderr, "[ERROR] duplicate source \n" );
             exit( EXIT_FAILURE );
         }
 
-        find = find_hash_node;
-        app->root = move_node( app->root, app->opts.arg_generic, app->opts.arg_hash, find );
+        app->root = move_node( app->root, app->opts.arg_generic, source, note_hashes( app ) );
 
         save_note( NULL, app );
-        save_to_file( app->root, app->cfg.file_note );
+        save_tree( app );
         break;
     }
 
     case CMD_REMOVE: { //! Remove note
+        TreeNode *nodeToRemove = NULL;
 
         if ( strlen( app->opts.arg_hash ) != 0 ) {
-            int cont = 0;
-            find = find_hash_node;
-            check_duplicate( app->root, app->opts.arg_hash, find, &cont );
-            if ( cont > 1 ) {
-                fprintf( stderr, "[ERROR] duplicate hash \n" );
-                exit( EXIT_FAILURE );
-            } else {
-                app->root = remove_node( app->root, app->opts.arg_hash );
-            }
+            nodeToRemove = find_hash( app, app->opts.arg_hash );
         } else if ( strlen( app->NDat.Tag ) != 0 ) {
-            int cont = 0;
             find = find_tag_node;
-            check_duplicate( app->root, app->NDat.Tag, find, &cont );
 
-            if ( cont > 1 ) {
-                cont = 0;
+            if ( tag_index_find( note_tags( app ), app->NDat.Tag, &nodeToRemove ) > 1 ) {
                 printf( "[WARNING] ambiguous tag\ndo you want to specify a hash? [Y/n]\n" );
                 char ch = getchar();
 
                 if ( ch != 'y' && ch != 'Y' && ch != '\n' ) {
                     exit( 0 );
                 }
-                print_find_node( app->root, app->NDat.Tag, find, app );
+                print_find_node( app->NDat.Tag, find, app );
 
                 char hash[41] = { '\0' };
                 printf( "Enter hash ->" );
                 scanf( "%40s", hash );
-                find = find_hash_node;
-                check_duplicate( app->root, hash, find, &cont );
 
-                if ( cont > 1 ) {
-                    fprintf( stderr, "[ERROR] duplicate hash \n" );
-                    exit( EXIT_FAILURE );
-                }
-
-                else {
-                    app->root = remove_node( app->root, hash );
-                }
-            } else {
-                TreeNode *nodeToRemove = find_node( app->root, app->NDat.Tag, find );
-                if ( nodeToRemove != NULL )
-                    app->root = remove_node( app->root, nodeToRemove->data.hash );
+                nodeToRemove = find_hash( app, hash );
             }
         } else {
             fprintf( stderr, "[ERROR] syntax error\n" );
             exit( EXIT_FAILURE );
         }
 
+        if ( nodeToRemove != NULL && nodeToRemove == app->root ) {
+            fprintf( stderr, "[ERROR] the root cannot be removed \n" );
+            exit( EXIT_FAILURE );
+        }
+
+        remove_note( nodeToRemove, app );
+
         save_note( NULL, app );
-        save_to_file( app->root, app->cfg.file_note );
+        save_tree( app );
         break;
     }
 
     case CMD_SETTING: { //! Change note file
-        remove( app->cfg.file_note );
         update_config_value( "SetFile", app->opts.arg_index, NULL, SetFile, &app->cfg, &app->stl );
         break;
     }
@@ -395,7 +344,14 @@ void controller( char *SetFile, char *Passwd, char *Key, AppGlobal *app ) {
         char backup[201];
         strcpy( backup, app->cfg.file_note );
         strcat( backup, "_Backup" );
-        copy_file( app->cfg.file_note, backup );
+        backup_note( backup, app );
+        break;
+    }
+
+    case CMD_COMPACT: { //! Rewrite the file without old notes, with the codec in the config
+        app->note.codec = NULL;
+        compact_note( NULL, app );
+        save_tree( app );
         break;
     }
 